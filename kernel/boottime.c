@@ -0,0 +1,79 @@
+/*
+ * boot phase timing. each phase of booting is stamped with the cycle and instret counters
+ * when it begins, and the breakdown is printed as one line of JSON right before the first
+ * instruction of the app runs, e.g.:
+ *
+ * {"boot_timing":[{"phase":"mentry","cycle":0,"instret":0,"cycles":1200,"instrets":900},
+ *   ...,{"phase":"return_to_user",...}],"total_cycles":...,"total_instrets":...}
+ *
+ * "cycles" and "instrets" are the duration of the phase (until the next one begins). the
+ * phases skipped by a run have all four values 0.
+ */
+
+#include "boottime.h"
+#include "riscv.h"
+
+#include "spike_interface/spike_utils.h"
+
+boot_stamp boot_stamps[NR_BOOT_PHASES];
+
+static const char *phase_names[NR_BOOT_PHASES] = {
+  [BOOT_MENTRY] = "mentry",
+  [BOOT_SPIKE_FILE_INIT] = "spike_file_init",
+  [BOOT_SNAPSHOT_LOAD] = "snapshot_load",
+  [BOOT_INIT_DTB] = "init_dtb",
+  [BOOT_DELEGATE_TRAPS] = "delegate_traps",
+  [BOOT_S_START] = "s_start",
+  [BOOT_ELF_ARGS] = "elf_args",
+  [BOOT_PMM_INIT] = "pmm_init",
+  [BOOT_KERN_VM_INIT] = "kern_vm_init",
+  [BOOT_LOAD_USER_PROGRAM] = "load_user_program",
+  [BOOT_ELF_OPEN] = "elf_open",
+  [BOOT_ELF_HEADER] = "elf_header",
+  [BOOT_ELF_SEGMENTS] = "elf_segments",
+  [BOOT_LOAD_OTHER_APPS] = "load_other_apps",
+  [BOOT_RETURN_TO_USER] = "return_to_user",
+};
+
+// set once the report is printed, later calls of boot_phase()/boot_report() do nothing
+static int boot_done = 0;
+
+//
+// stamp the beginning of a boot phase. works in both M and S mode (S mode may read the
+// counters once m_start() has set mcounteren).
+//
+void boot_phase(int phase) {
+  if (boot_done) return;
+  boot_stamps[phase].cycle = read_csr(cycle);
+  boot_stamps[phase].instret = read_csr(instret);
+}
+
+//
+// print the breakdown of booting as one line of JSON. called at the first entry to user
+// mode, which also ends the last phase.
+//
+void boot_report(void) {
+  if (boot_done) return;
+  uint64 end_cycle = read_csr(cycle), end_instret = read_csr(instret);
+  boot_done = 1;
+
+  // vprintk() formats at most 256 bytes at a time, so the line is printed in pieces.
+  sprint("{\"boot_timing\":[");
+  for (int i = 0; i < NR_BOOT_PHASES; i++) {
+    // the phase lasts until the next phase that is not skipped.
+    uint64 next_cycle = end_cycle, next_instret = end_instret;
+    for (int j = i + 1; j < NR_BOOT_PHASES; j++)
+      if (boot_stamps[j].cycle) {
+        next_cycle = boot_stamps[j].cycle;
+        next_instret = boot_stamps[j].instret;
+        break;
+      }
+    if (!boot_stamps[i].cycle) next_cycle = next_instret = 0;
+    sprint("%s{\"phase\":\"%s\",\"cycle\":%ld,\"instret\":%ld,\"cycles\":%ld,\"instrets\":%ld}",
+           i ? "," : "", phase_names[i], boot_stamps[i].cycle, boot_stamps[i].instret,
+           next_cycle - boot_stamps[i].cycle, next_instret - boot_stamps[i].instret);
+  }
+  sprint("],\"total_cycles\":%ld,\"total_instrets\":%ld}\n",
+         end_cycle - boot_stamps[BOOT_MENTRY].cycle,
+         end_instret - boot_stamps[BOOT_MENTRY].instret);
+}
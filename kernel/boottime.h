@@ -0,0 +1,40 @@
+#ifndef _BOOTTIME_H_
+#define _BOOTTIME_H_
+
+#include "util/types.h"
+
+// the phases of booting, from _mentry to the first instruction of the app. a phase lasts
+// until the next one begins, phases that are skipped (e.g., when a snapshot is restored)
+// are never stamped, and last 0 cycles.
+enum boot_phase {
+  BOOT_MENTRY,             // kernel/machine/mentry.S
+  BOOT_SPIKE_FILE_INIT,    // m_start()
+  BOOT_SNAPSHOT_LOAD,      // only when restoring a snapshot (kernel/snapshot.c)
+  BOOT_INIT_DTB,
+  BOOT_DELEGATE_TRAPS,
+  BOOT_S_START,            // s_start()
+  BOOT_ELF_ARGS,           // command line and kernel options (e.g., loading the initrd)
+  BOOT_PMM_INIT,
+  BOOT_KERN_VM_INIT,
+  BOOT_LOAD_USER_PROGRAM,  // load_user_program()
+  BOOT_ELF_OPEN,           // load_bincode_from_host_elf()
+  BOOT_ELF_HEADER,
+  BOOT_ELF_SEGMENTS,
+  BOOT_LOAD_OTHER_APPS,    // the applications after the first one, if any
+  BOOT_RETURN_TO_USER,     // the first switch_to()
+  NR_BOOT_PHASES
+};
+
+// the cycle and instret counters when a phase begins. boot_stamps[BOOT_MENTRY] is filled
+// by _mentry, and the layout must match the stores there.
+typedef struct boot_stamp_t {
+  uint64 cycle;    // offset 0
+  uint64 instret;  // offset 8
+} boot_stamp;
+
+extern boot_stamp boot_stamps[NR_BOOT_PHASES];
+
+void boot_phase(int phase);
+void boot_report(void);
+
+#endif
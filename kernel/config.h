@@ -4,17 +4,73 @@
 // we use only one HART (cpu) in fundamental experiments
 #define NCPU 1
 
+// the maximum number of processes, i.e., the size of the process pool
+#define NPROC 16
+
 #define DRAM_BASE 0x80000000
 
-/* we use fixed physical (also logical) addresses for the stacks and trap frames as in
- Bare memory-mapping mode */
-// user stack top
-#define USER_STACK 0x81100000
+// frequency of mtime (the time csr), i.e., the timebase-frequency of spike. it must divide
+// 1000000000, as nanoseconds are converted by a division.
+#define TIMEBASE_FREQ 10000000
+
+// the timer is tickless: it interrupts only at the next deadline (see kernel/timer.c).
+// TIMER_INTERVAL (in mtime units) is the period of polling the console while processes
+// wait for input.
+#define TIMER_INTERVAL 1000000
+
+// granularity (in mtime units) of the timer wheel, which deadlines are rounded up to
+#define TIMER_WHEEL_TICK 1000
+
+// sampling period (in mtime units) of the profiler
+#define PROFILE_INTERVAL 10000
+
+// events counted by the configurable hpm counters 3..6 (mhpmevent3..6), programmed at boot.
+// the event numbers are implementation defined, 0 leaves a counter unused: it is neither
+// programmed nor readable, and the perf calls on it fail. stock spike counts no hpm event,
+// so all are unused. set them for a platform that does count events.
+#define HPM_EVENT3 0
+#define HPM_EVENT4 0
+#define HPM_EVENT5 0
+#define HPM_EVENT6 0
+
+// the beginning virtual address of PKE kernel, which is mapped directly (i.e., virtual
+// address = physical address) in the kernel page table.
+#define KERN_BASE 0x80000000
+
+// the maximum memory space that PKE is allowed to manage.
+#define PKE_MAX_ALLOWABLE_RAM 128 * 1024 * 1024
+
+// the number of pre-zeroed pages that the physical memory manager keeps at hand (refilled
+// while the hart is idle or waits for the host), for the page faults and the elf loader
+#define ZEROED_POOL_PAGES 64
+
+// the ending physical address that PKE observes.
+#define PHYS_TOP (DRAM_BASE + PKE_MAX_ALLOWABLE_RAM)
+
+// virtual address of stack top of user process. the stack grows down from here on demand
+// (a page is allocated when first touched), up to the maximum size (USER_STACK_MAX by
+// default, or as set by the --stack-max kernel option). nothing is mapped in the guard gap
+// right below the maximum stack, so that an overflow faults rather than hitting a mapping.
+#define USER_STACK_TOP 0x7ffff000
+#define USER_STACK_MAX (8 * 1024 * 1024)
+#define USER_STACK_GUARD (16 * PGSIZE)
+
+// virtual address of the console output ring page (see util/print_ring.h), right above
+// the user stack
+#define USER_PRINT_RING USER_STACK_TOP
+
+// virtual addresses handed out by mmap() start from here
+#define USER_MMAP_START 0x40000000
+
+// shared memory segments are attached from here (up to USER_MMAP_START)
+#define USER_SHM_START 0x10000000
 
-// the stack used by PKE kernel when a syscall happens
-#define USER_KSTACK 0x81200000
+// position-independent apps (built with make PIE=1) are placed one after another from here
+// (up to USER_PIE_END), so that the apps resident at once all have addresses of their own
+#define USER_PIE_START 0x00400000
+#define USER_PIE_END 0x08000000
 
-// the trap frame used to assemble the user "process"
-#define USER_TRAP_FRAME 0x81300000
+// the heap (grown by brk) starts right after the (loaded) image of the app, and may reach
+// up to USER_SHM_START
 
 #endif
@@ -3,10 +3,23 @@
  * into the (emulated) memory.
  */
 
+#include <stddef.h>
+
 #include "elf.h"
 #include "string.h"
 #include "riscv.h"
+#include "vmm.h"
+#include "pmm.h"
+#include "util/functions.h"
 #include "spike_interface/spike_utils.h"
+#include "spike_interface/spike_initrd.h"
+#include "profile.h"
+#include "boottime.h"
+#include "trace.h"
+#include "snapshot.h"
+
+// g_mem_size is defined in spike_interface/spike_memory.c, size of the emulated memory
+extern uint64 g_mem_size;
 
 typedef struct elf_info_t {
   spike_file_t *f;
@@ -14,11 +27,32 @@ typedef struct elf_info_t {
 } elf_info;
 
 //
-// the implementation of allocater. allocates memory space for later segment loading
+// the implementation of allocater. allocates and maps the (zeroed) pages that hold
+// [elf_va, elf_va + size) in the address space of the process, with the protection prot.
+// a page shared with a previous segment is kept, and gets the union of both protections.
 //
-static void *elf_alloc_mb(elf_ctx *ctx, uint64 elf_pa, uint64 elf_va, uint64 size) {
-  // directly returns the virtual address as we are in the Bare mode in lab1_x
-  return (void *)elf_va;
+static elf_status elf_alloc_mb(elf_ctx *ctx, uint64 elf_va, uint64 size, int prot) {
+  elf_info *msg = (elf_info *)ctx->info;
+  pagetable_t page_dir = msg->p->pagetable;
+  uint64 first = ROUNDDOWN(elf_va, PGSIZE), last = ROUNDUP(elf_va + size, PGSIZE);
+
+  // build the page tables first, so that the pages of the segment itself are allocated
+  // back to back, and are mostly physically contiguous.
+  for (uint64 va = first; va < last; va += PGSIZE)
+    if (!page_walk(page_dir, va, 1)) return EL_ENOMEM;
+
+  for (uint64 va = first; va < last; va += PGSIZE) {
+    pte_t *pte = page_walk(page_dir, va, 0);
+    if (*pte & PTE_V) {
+      *pte |= prot_to_type(prot, 1);
+      continue;
+    }
+    // the page comes zeroed, which is what the bss needs.
+    void *pa = alloc_zeroed_page();
+    if (pa == 0) return EL_ENOMEM;
+    user_vm_map(page_dir, va, PGSIZE, (uint64)pa, prot_to_type(prot, 1));
+  }
+  return EL_OK;
 }
 
 //
@@ -37,6 +71,7 @@ static uint64 elf_fpread(elf_ctx *ctx, void *dest, uint64 nb, uint64 offset) {
 //
 elf_status elf_init(elf_ctx *ctx, void *info) {
   ctx->info = info;
+  ctx->bias = 0;
 
   // load the elf header
   if (elf_fpread(ctx, &ctx->ehdr, sizeof(ctx->ehdr), 0) != sizeof(ctx->ehdr)) return EL_EIO;
@@ -48,12 +83,121 @@ elf_status elf_init(elf_ctx *ctx, void *info) {
 }
 
 //
-// load the elf segments to memory regions as we are in Bare mode in lab1
+// read nb bytes of the elf from offset into the address space of the process at elf_va.
+// the pages are not contiguous in general, but each physically contiguous run of them is
+// filled with one read.
+//
+static elf_status elf_load_mb(elf_ctx *ctx, uint64 elf_va, uint64 nb, uint64 offset) {
+  elf_info *msg = (elf_info *)ctx->info;
+  pagetable_t page_dir = msg->p->pagetable;
+  uint64 pos = elf_va, end = elf_va + nb;
+
+  while (pos < end) {
+    uint64 pa = lookup_pa(page_dir, pos) + (pos & (PGSIZE - 1));
+    uint64 n = MIN(end - pos, PGSIZE - (pos & (PGSIZE - 1)));
+    while (pos + n < end && lookup_pa(page_dir, pos + n) == pa + n)
+      n += MIN(end - pos - n, PGSIZE);
+
+    if (elf_fpread(ctx, (void *)pa, n, offset + (pos - elf_va)) != n) return EL_EIO;
+    pos += n;
+  }
+  return EL_OK;
+}
+
+// PIE images are placed one after another from USER_PIE_START, so that each app loaded
+// has addresses of its own.
+static uint64 next_pie_base = USER_PIE_START;
+
+//
+// choose where a PIE goes: find the extent of its loadable segments, and set the bias that
+// moves them to a free place. also returns the (unrelocated) address of the dynamic segment
+// in dyn_va, or 0 if there is none.
+//
+static elf_status elf_place(elf_ctx *ctx, uint64 *dyn_va) {
+  elf_prog_header ph_addr;
+  uint64 lo = -1, hi = 0;
+  *dyn_va = 0;
+
+  for (int i = 0, off = ctx->ehdr.phoff; i < ctx->ehdr.phnum; i++, off += sizeof(ph_addr)) {
+    if (elf_fpread(ctx, (void *)&ph_addr, sizeof(ph_addr), off) != sizeof(ph_addr)) return EL_EIO;
+    if (ph_addr.type == ELF_PROG_DYNAMIC) *dyn_va = ph_addr.vaddr;
+    if (ph_addr.type != ELF_PROG_LOAD) continue;
+    lo = MIN(lo, ROUNDDOWN(ph_addr.vaddr, PGSIZE));
+    hi = MAX(hi, ROUNDUP(ph_addr.vaddr + ph_addr.memsz, PGSIZE));
+  }
+  if (hi <= lo) return EL_ERR;
+
+  // keep a guard page between two images.
+  uint64 base = next_pie_base;
+  if (base + (hi - lo) > USER_PIE_END) return EL_ENOMEM;
+  next_pie_base = base + (hi - lo) + PGSIZE;
+
+  ctx->bias = base - lo;
+  return EL_OK;
+}
+
+// the (kernel) address of the 8-byte word at user va, which must be aligned so that the
+// word does not cross a page. returns NULL if va is misaligned or not mapped.
+static uint64 *user_word(pagetable_t page_dir, uint64 va) {
+  if (va & (sizeof(uint64) - 1)) return NULL;
+  return user_va_to_pa(page_dir, (void *)va);
+}
+
+//
+// apply the relocations of a PIE loaded with ctx->bias, as listed by its dynamic segment
+// at dyn_va (unrelocated). the relocations are read from, and applied to, the loaded image
+// word by word, through the physical pages, so that read-only pages can be patched as well.
+//
+static elf_status elf_relocate(elf_ctx *ctx, uint64 dyn_va) {
+  pagetable_t page_dir = ((elf_info *)ctx->info)->p->pagetable;
+  uint64 rela = 0, relasz = 0, relaent = sizeof(elf_rela);
+
+  for (uint64 va = dyn_va + ctx->bias;; va += sizeof(elf_dyn)) {
+    uint64 *tag = user_word(page_dir, va + offsetof(elf_dyn, tag));
+    uint64 *val = user_word(page_dir, va + offsetof(elf_dyn, val));
+    if (!tag || !val) return EL_ERR;
+    if (*tag == ELF_DT_NULL) break;
+    if (*tag == ELF_DT_RELA) rela = *val;
+    else if (*tag == ELF_DT_RELASZ) relasz = *val;
+    else if (*tag == ELF_DT_RELAENT) relaent = *val;
+  }
+  if (relaent < sizeof(elf_rela)) return EL_ERR;
+
+  for (uint64 va = rela + ctx->bias; va < rela + ctx->bias + relasz; va += relaent) {
+    uint64 *offset = user_word(page_dir, va + offsetof(elf_rela, offset));
+    uint64 *info = user_word(page_dir, va + offsetof(elf_rela, info));
+    uint64 *addend = user_word(page_dir, va + offsetof(elf_rela, addend));
+    if (!offset || !info || !addend) return EL_ERR;
+    uint32 type = *info & 0xffffffff;
+    if (type == R_RISCV_NONE) continue;
+    // a static PIE has no symbols to resolve, anything else is not supported.
+    if (type != R_RISCV_RELATIVE) return EL_ERR;
+
+    uint64 *where = user_word(page_dir, *offset + ctx->bias);
+    if (!where) return EL_ERR;
+    *where = ctx->bias + *addend;
+  }
+  return EL_OK;
+}
+
+//
+// load the elf segments to the pages of the process. a PIE is placed at an address of
+// its own, and relocated.
 //
 elf_status elf_load(elf_ctx *ctx) {
   // elf_prog_header structure is defined in kernel/elf.h
   elf_prog_header ph_addr;
   int i, off;
+  // the end of the (loaded) image, where the heap starts
+  uint64 end = 0;
+
+  uint64 dyn_va = 0;
+  if (ctx->ehdr.type == ELF_TYPE_DYN) {
+    elf_status ret = elf_place(ctx, &dyn_va);
+    if (ret != EL_OK) return ret;
+  } else if (ctx->ehdr.type != ELF_TYPE_EXEC) {
+    return EL_ERR;
+  }
 
   // traverse the elf program segment headers
   for (i = 0, off = ctx->ehdr.phoff; i < ctx->ehdr.phnum; i++, off += sizeof(ph_addr)) {
@@ -63,15 +207,28 @@ elf_status elf_load(elf_ctx *ctx) {
     if (ph_addr.type != ELF_PROG_LOAD) continue;
     if (ph_addr.memsz < ph_addr.filesz) return EL_ERR;
     if (ph_addr.vaddr + ph_addr.memsz < ph_addr.vaddr) return EL_ERR;
+    ph_addr.vaddr += ctx->bias;
+    if (ph_addr.vaddr + ph_addr.memsz > USER_SHM_START) return EL_ERR;
+    end = MAX(end, ph_addr.vaddr + ph_addr.memsz);
 
     // allocate memory block before elf loading
-    void *dest = elf_alloc_mb(ctx, ph_addr.vaddr, ph_addr.vaddr, ph_addr.memsz);
+    int prot = (ph_addr.flags & ELF_PROG_FLAG_R ? PROT_READ : 0) |
+               (ph_addr.flags & ELF_PROG_FLAG_W ? PROT_WRITE : 0) |
+               (ph_addr.flags & ELF_PROG_FLAG_X ? PROT_EXEC : 0);
+    TRACE(TRACE_ELF_SEG_BEGIN, ph_addr.vaddr, ph_addr.memsz);
+    elf_status ret = elf_alloc_mb(ctx, ph_addr.vaddr, ph_addr.memsz, prot);
+    if (ret != EL_OK) return ret;
 
-    // actual loading
-    if (elf_fpread(ctx, dest, ph_addr.memsz, ph_addr.off) != ph_addr.memsz)
-      return EL_EIO;
+    // actual loading. the part of the segment beyond filesz (i.e., bss) stays zero.
+    ret = elf_load_mb(ctx, ph_addr.vaddr, ph_addr.filesz, ph_addr.off);
+    if (ret != EL_OK) return ret;
+    TRACE(TRACE_ELF_SEG_END, ph_addr.vaddr, ph_addr.filesz);
   }
 
+  process *p = ((elf_info *)ctx->info)->p;
+  p->heap_start = p->heap_end = ROUNDUP(end, PGSIZE);
+
+  if (dyn_va) return elf_relocate(ctx, dyn_va);
   return EL_OK;
 }
 
@@ -101,37 +258,159 @@ static size_t parse_args(arg_buf *arg_bug_msg) {
   return pk_argc - arg;
 }
 
+#define INITRD_OPT "--initrd="
+#define PROFILE_OPT "--profile="
+#define TRACE_OPT "--trace="
+#define STACK_MAX_OPT "--stack-max="
+
 //
-// load the elf of user application, by using the spike file interface.
+// handle the kernel options, which start with "--" and precede the application name:
+//   --initrd=<cpio archive>  load the archive from the host at boot, and serve the files
+//                            in it (including the application) from memory.
+//   --profile=<host file>    sample the pc every PROFILE_INTERVAL, and write the samples
+//                            to the host file at shutdown (see tools/pke_prof.py).
+//   --trace=<host file>      record the tracepoints into the host file (the kernel must
+//                            be built with make TRACE=1, see tools/pke_trace.py).
+//   --stack-max=<KB>         the maximum size of the user stacks (USER_STACK_MAX by default).
+//   --snapshot-save=<host file>
+//                            write the kernel state to the host file before loading the
+//                            application (see kernel/snapshot.c). not with --trace or
+//                            --profile, whose state belongs to the run that saves.
+//   --snapshot=<host file>   restore the kernel state from the host file, rather than
+//                            booting. handled by m_start(), nothing to do here.
+// a kernel restored from a snapshot keeps the options of the run that took it, and skips
+// them (resume is set). returns the number of arguments consumed. all the arguments after the
+// options name applications, which are loaded together. nothing preempts a process, so they
+// run one after another in the order given, unless they block (e.g., sleep or wait).
 //
-void load_bincode_from_host_elf(process *p) {
-  arg_buf arg_bug_msg;
+static size_t parse_kernel_opts(size_t argc, char **argv, int resume) {
+  size_t i;
+  int tracing = 0, profiling = 0, saving = 0;
+  for (i = 0; i < argc && strncmp(argv[i], "--", 2) == 0; i++) {
+    if (resume || strncmp(argv[i], SNAPSHOT_OPT, strlen(SNAPSHOT_OPT)) == 0) {
+      continue;
+    } else if (strncmp(argv[i], INITRD_OPT, strlen(INITRD_OPT)) == 0) {
+      const char *path = argv[i] + strlen(INITRD_OPT);
+      // the archive goes to the top of the emulated memory, above the memory managed by
+      // the physical memory manager.
+      long base = initrd_load(path, PHYS_TOP, DRAM_BASE + g_mem_size);
+      if (base < 0) panic("Fail on loading the initrd %s.\n", path);
+      sprint("Initrd: %s loaded at 0x%lx\n", path, base);
+    } else if (strncmp(argv[i], PROFILE_OPT, strlen(PROFILE_OPT)) == 0) {
+      if (profile_start(argv[i] + strlen(PROFILE_OPT)) != 0)
+        panic("Profile path %s is too long.\n", argv[i]);
+      profiling = 1;
+    } else if (strncmp(argv[i], TRACE_OPT, strlen(TRACE_OPT)) == 0) {
+      if (trace_start(argv[i] + strlen(TRACE_OPT)) != 0)
+        panic("Fail on tracing to %s (is the kernel built with TRACE=1?).\n", argv[i]);
+      tracing = 1;
+    } else if (strncmp(argv[i], STACK_MAX_OPT, strlen(STACK_MAX_OPT)) == 0) {
+      // the stack, and the guard gap below it, must stay above the mmap area.
+      const char *s = argv[i] + strlen(STACK_MAX_OPT);
+      uint64 kb = 0;
+      while (*s >= '0' && *s <= '9' && kb < USER_STACK_TOP) kb = kb * 10 + (*s++ - '0');
+      uint64 size = ROUNDUP(kb * 1024, PGSIZE);
+      if (*s || size == 0 || size > USER_STACK_TOP - USER_MMAP_START - USER_STACK_GUARD)
+        panic("Bad stack size %s.\n", argv[i]);
+      user_stack_max = size;
+    } else if (strncmp(argv[i], SNAPSHOT_SAVE_OPT, strlen(SNAPSHOT_SAVE_OPT)) == 0) {
+      if (snapshot_request_save(argv[i] + strlen(SNAPSHOT_SAVE_OPT)) != 0)
+        panic("Snapshot path %s is too long.\n", argv[i]);
+      saving = 1;
+    } else {
+      panic("Unknown kernel option %s.\n", argv[i]);
+    }
+  }
+  // the trace file is open on the host, a restored kernel could not write to it. and the
+  // snapshot would carry the samples and records taken so far (and the tracing and
+  // profiling on), which belong to this run only.
+  if (tracing && saving) panic("--trace can not be used with --snapshot-save.\n");
+  if (profiling && saving) panic("--profile can not be used with --snapshot-save.\n");
+  return i;
+}
+
+// the command line (after the PKE kernel), the index of the first application name in it,
+// and the number of arguments.
+static arg_buf arg_bug_msg;
+static size_t app_arg, nargs;
 
-  // retrieve command line arguements
+//
+// retrieve the command line arguments, and handle the kernel options (unless resume is set,
+// i.e., the kernel is restored from a snapshot).
+//
+void handle_cmdline(int resume) {
+  nargs = parse_args(&arg_bug_msg);
+  app_arg = parse_kernel_opts(nargs, arg_bug_msg.argv, resume);
+  if (app_arg == nargs) panic("You need to specify the application program!\n");
+}
+
+//
+// returns the name of the i-th application on the command line (all arguments after the
+// kernel options are applications), or NULL if there are fewer.
+//
+const char *cmdline_app(int i) {
+  return app_arg + i < nargs ? arg_bug_msg.argv[app_arg + i] : NULL;
+}
+
+//
+// look up the kernel option opt (e.g., "--snapshot=") on the command line, and copy its
+// value to val (of n bytes). returns 0 on success, or -1 if the option is not there. works
+// in M mode too, before handle_cmdline().
+//
+int cmdline_option(const char *opt, char *val, size_t n) {
   size_t argc = parse_args(&arg_bug_msg);
-  if (!argc) panic("You need to specify the application program!\n");
+  for (size_t i = 0; i < argc && strncmp(arg_bug_msg.argv[i], "--", 2) == 0; i++) {
+    if (strncmp(arg_bug_msg.argv[i], opt, strlen(opt)) != 0) continue;
+    const char *v = arg_bug_msg.argv[i] + strlen(opt);
+    if (strlen(v) >= n) return -1;
+    strcpy(val, v);
+    return 0;
+  }
+  return -1;
+}
+
+//
+// stamp a boot phase of loading an elf, unless the application is not the first one (whose
+// loading is all in BOOT_LOAD_OTHER_APPS, see start_app() in kernel/kernel.c).
+//
+static void elf_boot_phase(int phase) {
+  if (boot_stamps[BOOT_LOAD_OTHER_APPS].cycle == 0) boot_phase(phase);
+}
 
-  sprint("Application: %s\n", arg_bug_msg.argv[0]);
+//
+// load the elf of user application path, by using the spike file interface.
+//
+void load_bincode_from_host_elf(process *p, const char *path) {
+  sprint("Application: %s\n", path);
 
   //elf loading. elf_ctx is defined in kernel/elf.h, used to track the loading process.
   elf_ctx elfloader;
   // elf_info is defined above, used to tie the elf file and its corresponding process.
   elf_info info;
 
-  info.f = spike_file_open(arg_bug_msg.argv[0], O_RDONLY, 0);
+  // spike_file_open() serves the application from the initrd, if it is there.
+  elf_boot_phase(BOOT_ELF_OPEN);
+  info.f = spike_file_open(path, O_RDONLY, 0);
   info.p = p;
   // IS_ERR_VALUE is a macro defined in spike_interface/spike_htif.h
   if (IS_ERR_VALUE(info.f)) panic("Fail on openning the input application program.\n");
 
-  // init elfloader context. elf_init() is defined above.
+  // init elfloader context (reads the elf header). elf_init() is defined above.
+  elf_boot_phase(BOOT_ELF_HEADER);
   if (elf_init(&elfloader, &info) != EL_OK)
     panic("fail to init elfloader.\n");
 
   // load elf. elf_load() is defined above.
-  if (elf_load(&elfloader) != EL_OK) panic("Fail on loading elf.\n");
+  elf_boot_phase(BOOT_ELF_SEGMENTS);
+  TRACE(TRACE_ELF_LOAD_BEGIN, elfloader.ehdr.entry, 0);
+  elf_status status = elf_load(&elfloader);
+  TRACE(TRACE_ELF_LOAD_END, status, 0);
+  if (status != EL_OK) panic("Fail on loading elf.\n");
 
-  // entry (virtual, also physical in lab1_x) address
-  p->trapframe->epc = elfloader.ehdr.entry;
+  // entry (virtual) address, moved along with the image if it is a PIE
+  p->trapframe->epc = elfloader.ehdr.entry + elfloader.bias;
+  // the profiler symbolises the pcs of the process at link addresses.
+  profile_set_bias(p->pid, elfloader.bias);
 
   // close the host spike file
   spike_file_close( info.f );
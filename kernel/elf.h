@@ -37,8 +37,42 @@ typedef struct elf_prog_header_t {
   uint64 align;  /* Segment alignment */
 } elf_prog_header;
 
+// an entry of the dynamic segment
+typedef struct elf_dyn_t {
+  int64 tag;
+  uint64 val;
+} elf_dyn;
+
+// a relocation with an addend
+typedef struct elf_rela_t {
+  uint64 offset;  /* Address to relocate (unrelocated virtual address) */
+  uint64 info;    /* Symbol index (high 32 bits) and type (low 32 bits) */
+  int64 addend;
+} elf_rela;
+
 #define ELF_MAGIC 0x464C457FU  // "\x7FELF" in little endian
 #define ELF_PROG_LOAD 1
+#define ELF_PROG_DYNAMIC 2
+
+// types of elf files: an executable is loaded at its link address, a shared object (e.g.,
+// a static PIE) wherever the loader places it
+#define ELF_TYPE_EXEC 2
+#define ELF_TYPE_DYN 3
+
+// tags of the dynamic segment that locate the relocations
+#define ELF_DT_NULL 0
+#define ELF_DT_RELA 7
+#define ELF_DT_RELASZ 8
+#define ELF_DT_RELAENT 9
+
+// relocation types of RISC-V. a static PIE only needs R_RISCV_RELATIVE.
+#define R_RISCV_NONE 0
+#define R_RISCV_RELATIVE 3
+
+// flags of a program segment
+#define ELF_PROG_FLAG_X 1
+#define ELF_PROG_FLAG_W 2
+#define ELF_PROG_FLAG_R 4
 
 typedef enum elf_status_t {
   EL_OK = 0,
@@ -53,11 +87,16 @@ typedef enum elf_status_t {
 typedef struct elf_ctx_t {
   void *info;
   elf_header ehdr;
+  // added to the addresses of the elf to get where it is loaded, 0 unless it is a PIE
+  uint64 bias;
 } elf_ctx;
 
 elf_status elf_init(elf_ctx *ctx, void *info);
 elf_status elf_load(elf_ctx *ctx);
 
-void load_bincode_from_host_elf(process *p);
+void handle_cmdline(int resume);
+int cmdline_option(const char *opt, char *val, size_t n);
+const char *cmdline_app(int i);
+void load_bincode_from_host_elf(process *p, const char *path);
 
 #endif
@@ -0,0 +1,49 @@
+/*
+ * futexes: processes wait for a 32-bit word in their memory to change, and are woken up by
+ * whoever changes it. the user library builds mutexes and condition variables on them,
+ * which only enter the kernel when they are contended (see user/usync.c).
+ *
+ * a futex is identified by the physical address of its word, so that processes sharing a
+ * page also share the futexes in it. waiting processes sleep on one of FUTEX_HASH_SIZE wait
+ * queues, chosen by hashing that address, and remember it in wait_key.
+ */
+
+#include "futex.h"
+#include "process.h"
+#include "sched.h"
+#include "mmap.h"
+
+static wait_queue futex_queues[FUTEX_HASH_SIZE];
+
+static wait_queue *queue_of(uint64 key) {
+  return &futex_queues[(((key >> 2) * 0x9E3779B97F4A7C15ULL) >> 32) % FUTEX_HASH_SIZE];
+}
+
+//
+// wait until woken up by do_futex_wake(), if the word at addr still holds expected.
+// returns 0 at once if it does not (a woken process re-issues the syscall, and also sees
+// the changed word), or -1 if addr is not a valid (aligned, readable) address.
+//
+long do_futex_wait(uint64 addr, int expected) {
+  if (addr & 3) return -1;
+  volatile int *word = user_va_to_pa_fault(current, addr, 0);
+  if (!word) return -1;
+  if (*word != expected) return 0;
+
+  // sleep_on() is defined in kernel/sched.c, and never returns.
+  current->wait_key = (uint64)word;
+  sleep_on(queue_of((uint64)word));
+  return 0;
+}
+
+//
+// wake up at most n processes waiting on the futex at addr. returns the number of
+// processes woken up, or -1 if addr is not a valid address.
+//
+long do_futex_wake(uint64 addr, int n) {
+  if (addr & 3) return -1;
+  uint64 key = (uint64)user_va_to_pa_fault(current, addr, 0);
+  if (!key) return -1;
+
+  return wakeup_key(queue_of(key), key, n);
+}
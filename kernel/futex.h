@@ -0,0 +1,12 @@
+#ifndef _FUTEX_H_
+#define _FUTEX_H_
+
+#include "util/types.h"
+
+// number of wait queues, processes waiting on different futexes may share one
+#define FUTEX_HASH_SIZE 64
+
+long do_futex_wait(uint64 addr, int expected);
+long do_futex_wake(uint64 addr, int n);
+
+#endif
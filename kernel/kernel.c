@@ -6,47 +6,138 @@
 #include "string.h"
 #include "elf.h"
 #include "process.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "sched.h"
+#include "timer.h"
+#include "boottime.h"
+#include "snapshot.h"
 
 #include "spike_interface/spike_utils.h"
 
-// process is a structure defined in kernel/process.h
-process user_app;
+//
+// turn on paging.
+//
+void enable_paging() {
+  // write the pointer to kernel page (table) directory into the CSR of "satp".
+  write_csr(satp, MAKE_SATP(g_kernel_pagetable));
+
+  // refresh tlb to invalidate its content.
+  flush_tlb();
+}
 
 //
-// load the elf, and construct a "process" (with only a trapframe).
+// load the elf into a new process (with its own page table).
 // load_bincode_from_host_elf is defined in elf.c
 //
-void load_user_program(process *proc) {
-  // USER_TRAP_FRAME is a physical address defined in kernel/config.h
-  proc->trapframe = (trapframe *)USER_TRAP_FRAME;
-  memset(proc->trapframe, 0, sizeof(trapframe));
-  // USER_KSTACK is also a physical address defined in kernel/config.h
-  proc->kstack = USER_KSTACK;
-  proc->trapframe->regs.sp = USER_STACK;
+process *load_user_program(const char *path) {
+  sprint("User application is loading.\n");
+  // alloc_process() is defined in kernel/process.c, it gives the process its trapframe,
+  // its kernel stack and its page table.
+  process *proc = alloc_process();
+  if (!proc) panic("Fail on allocating the user process.\n");
+
+  // the user stack grows down from USER_STACK_TOP (defined in kernel/config.h). nothing is
+  // mapped yet, its pages are allocated on first touch by handle_stack_fault() (defined in
+  // kernel/mmap.c), down to proc->stack_limit.
+  proc->trapframe->regs.sp = USER_STACK_TOP;  //virtual address of user stack top
+
+  sprint("user frame 0x%lx, user stack 0x%lx, user kstack 0x%lx \n", proc->trapframe,
+         proc->trapframe->regs.sp, proc->kstack);
 
   // load_bincode_from_host_elf() is defined in kernel/elf.c
-  load_bincode_from_host_elf(proc);
+  load_bincode_from_host_elf(proc, path);
+  return proc;
+}
+
+//
+// load the application, and put it into execution. never returns.
+//
+static void start_app(void) {
+  // the application code (elf) is first loaded into memory, and then put into execution.
+  // all the applications on the command line are loaded ahead of time, each into a process
+  // of its own, so that they are resident at once. they run one after another (nothing
+  // preempts them), unless they block. cmdline_app() is defined in kernel/elf.c
+  boot_phase(BOOT_LOAD_USER_PROGRAM);
+  // from now on, the pool of zeroed pages is filled while the loader waits for the host,
+  // ahead of the bss of the applications. start_zeroing_ahead() is defined in kernel/pmm.c
+  start_zeroing_ahead();
+  // start the (tickless) timer interrupt. timer_start() is defined in kernel/timer.c
+  timer_start();
+
+  const char *path;
+  for (int i = 0; (path = cmdline_app(i)) != NULL; i++) {
+    // the elf phases break down the loading of the first application only, the others are
+    // loaded in a phase of their own.
+    if (i == 1) boot_phase(BOOT_LOAD_OTHER_APPS);
+    process *app = load_user_program(path);
+    // the applications are the first processes in the ready queue, others are forked
+    // from them. insert_to_ready_queue() is defined in kernel/sched.c
+    insert_to_ready_queue(app);
+  }
+
+  sprint("Switch to user mode...\n");
+  // schedule() is defined in kernel/sched.c
+  schedule();
 }
 
 //
 // s_start: S-mode entry point of riscv-pke OS kernel.
 //
 int s_start(void) {
+  boot_phase(BOOT_S_START);
   sprint("Enter supervisor mode...\n");
-  // Note: we use direct (i.e., Bare mode) for memory mapping in lab1.
-  // which means: Virtual Address = Physical Address
-  // therefore, we need to set satp to be 0 for now. we will enable paging in lab2_x.
-  // 
+  // in the beginning, we use Bare mode (direct) memory mapping, and switch to the paging
+  // mode once the kernel page table is built.
+  // note, the code still works in Bare mode when calling pmm_init() and kern_vm_init().
+  //
   // write_csr is a macro defined in kernel/riscv.h
   write_csr(satp, 0);
 
-  // the application code (elf) is first loaded into memory, and then put into execution
-  load_user_program(&user_app);
+  // read the command line, and handle the kernel options (e.g., --initrd). this is done
+  // before pmm_init(), which hands out the memory up to PHYS_TOP, and kern_vm_init(), which
+  // maps the initrd. handle_cmdline() is defined in kernel/elf.c
+  boot_phase(BOOT_ELF_ARGS);
+  handle_cmdline(0);
 
-  sprint("Switch to user mode...\n");
-  // switch_to() is defined in kernel/process.c
-  switch_to(&user_app);
+  // init phisical memory manager
+  boot_phase(BOOT_PMM_INIT);
+  pmm_init();
+
+  // build the kernel page table
+  boot_phase(BOOT_KERN_VM_INIT);
+  kern_vm_init();
+
+  // now, switch to paging mode by turning on paging (SV39)
+  enable_paging();
+  // the code now formally works in paging mode, meaning the page table is now in use.
+  sprint("kernel page table is on \n");
+
+  // with --snapshot-save, the kernel state as of now goes to the host. snapshot_save() is
+  // defined in kernel/snapshot.c
+  snapshot_save();
+
+  start_app();
+  // we should never reach here.
+  return 0;
+}
+
+//
+// s_resume: S-mode entry point of a kernel restored from a snapshot (see kernel/snapshot.c),
+// which carries on from where the snapshot was taken, i.e., right before loading the app.
+//
+int s_resume(void) {
+  boot_phase(BOOT_S_START);
+  sprint("Enter supervisor mode (restored from a snapshot)...\n");
+
+  // the application to run is named by the command line of this run.
+  boot_phase(BOOT_ELF_ARGS);
+  handle_cmdline(1);
+
+  // the kernel page table is in the restored memory.
+  enable_paging();
 
+  start_app();
   // we should never reach here.
   return 0;
 }
@@ -5,6 +5,8 @@
 #include "util/types.h"
 #include "kernel/riscv.h"
 #include "kernel/config.h"
+#include "kernel/boottime.h"
+#include "kernel/snapshot.h"
 #include "spike_interface/spike_utils.h"
 
 //
@@ -17,8 +19,20 @@
 //
 __attribute__((aligned(16))) char stack0[4096 * NCPU];
 
+// the stack(s) used by M-mode trap handling (cf. kernel/machine/mtrap_vector.S)
+__attribute__((aligned(16))) char mtrap_stack[4096 * NCPU];
+
+// mtrapvec is the M-mode trap vector, defined in kernel/machine/mtrap_vector.S
+extern void mtrapvec();
+
+// struct riscv_regs is define in kernel/riscv.h, and g_itrframe is used to save
+// registers when interrupt hapens in M mode.
+riscv_regs g_itrframe;
+
 // sstart() is the supervisor state entry point defined in kernel/kernel.c
 extern void s_start();
+// s_resume() is the entry point of a kernel restored from a snapshot, in kernel/kernel.c
+extern void s_resume();
 
 // htif is defined in spike_interface/spike_htif.c, marks the availability of HTIF
 extern uint64 htif;
@@ -71,6 +85,41 @@ static void delegate_traps() {
   assert(read_csr(medeleg) == exceptions);
 }
 
+//
+// enabling timer interrupt (irq) in Machine mode.
+//
+void timerinit(uintptr_t hartid) {
+  // the timer is tickless (see kernel/machine/mtrap.c): nothing fires until the S-mode
+  // kernel asks for its first deadline.
+  *(uint64*)CLINT_MTIMECMP(hartid) = -1;
+
+  // enable machine-mode timer irq in MIE (Machine Interrupt Enable) csr.
+  write_csr(mie, read_csr(mie) | MIE_MTIE);
+}
+
+//
+// select the events counted by the hpm counters 3..6 (see kernel/perf.c for how they are
+// virtualized per process), and start them from zero.
+//
+static void hpm_init() {
+  if (HPM_EVENT3) {
+    write_csr(mhpmevent3, HPM_EVENT3);
+    write_csr(mhpmcounter3, 0);
+  }
+  if (HPM_EVENT4) {
+    write_csr(mhpmevent4, HPM_EVENT4);
+    write_csr(mhpmcounter4, 0);
+  }
+  if (HPM_EVENT5) {
+    write_csr(mhpmevent5, HPM_EVENT5);
+    write_csr(mhpmcounter5, 0);
+  }
+  if (HPM_EVENT6) {
+    write_csr(mhpmevent6, HPM_EVENT6);
+    write_csr(mhpmcounter6, 0);
+  }
+}
+
 //
 // m_start: machine mode C entry point.
 //
@@ -78,24 +127,63 @@ void m_start(uintptr_t hartid, uintptr_t dtb) {
   // init the spike file interface (stdin,stdout,stderr)
   // functions with "spike_" prefix are all defined in codes under spike_interface/,
   // sprint is also defined in spike_interface/spike_utils.c
+  boot_phase(BOOT_SPIKE_FILE_INIT);
   spike_file_init();
   sprint("In m_start, hartid:%d\n", hartid);
 
+  // with the kernel option --snapshot, read the kernel state saved by an earlier run,
+  // which makes the rest of booting unnecessary. snapshot_load() is defined in
+  // kernel/snapshot.c
+  boot_phase(BOOT_SNAPSHOT_LOAD);
+  int restoring = snapshot_load();
+
   // init HTIF (Host-Target InterFace) and memory by using the Device Table Blob (DTB)
-  // init_dtb() is defined above.
-  init_dtb(dtb);
+  // init_dtb() is defined above. a snapshot has the results already.
+  if (!restoring) {
+    boot_phase(BOOT_INIT_DTB);
+    init_dtb(dtb);
+  }
 
   // set previous privilege mode to S (Supervisor), and will enter S mode after 'mret'
   // write_csr is a macro defined in kernel/riscv.h
   write_csr(mstatus, ((read_csr(mstatus) & ~MSTATUS_MPP_MASK) | MSTATUS_MPP_S));
 
-  // set M Exception Program Counter to sstart, for mret (requires gcc -mcmodel=medany)
-  write_csr(mepc, (uint64)s_start);
+  // set M Exception Program Counter to sstart (or s_resume when restoring a snapshot), for
+  // mret (requires gcc -mcmodel=medany)
+  write_csr(mepc, restoring ? (uint64)s_resume : (uint64)s_start);
 
   // delegate all interrupts and exceptions to supervisor mode.
   // delegate_traps() is defined above.
+  boot_phase(BOOT_DELEGATE_TRAPS);
   delegate_traps();
 
+  // program the events of the hpm counters. hpm_init() is defined above.
+  hpm_init();
+
+  // let S and U modes read the cycle, time, instret and (programmed) hpm counters (e.g.,
+  // rdcycle), such that the kernel and applications can time themselves.
+  uint64 counteren = COUNTEREN_CY | COUNTEREN_TM | COUNTEREN_IR |
+                     (HPM_EVENT3 ? COUNTEREN_HPM(3) : 0) | (HPM_EVENT4 ? COUNTEREN_HPM(4) : 0) |
+                     (HPM_EVENT5 ? COUNTEREN_HPM(5) : 0) | (HPM_EVENT6 ? COUNTEREN_HPM(6) : 0);
+  write_csr(mcounteren, counteren);
+  write_csr(scounteren, counteren);
+
+  // save the address of trap frame for interrupt in M mode to "mscratch".
+  write_csr(mscratch, &g_itrframe);
+
+  // set machine-mode trap vector, and enable machine-mode interrupts.
+  write_csr(mtvec, (uint64)mtrapvec);
+  write_csr(mstatus, read_csr(mstatus) | MSTATUS_MIE);
+
+  // let S mode receive the software interrupts that forward the timer ticks.
+  write_csr(sie, read_csr(sie) | SIE_SSIE);
+
+  // init timing.
+  timerinit(hartid);
+
+  // put the snapshot into place, and enter S mode at s_resume(). never returns.
+  if (restoring) snapshot_restore();
+
   // switch to supervisor mode (S mode) and jump to s_start(), i.e., set pc to mepc
   asm volatile("mret");
 }
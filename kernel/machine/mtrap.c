@@ -0,0 +1,83 @@
+/*
+ * Machine-mode trap handling. the only interrupt that PKE handles in M mode is the timer
+ * (the CLINT timer interrupt can not be delegated), which is forwarded to the S-mode kernel
+ * as a software interrupt.
+ *
+ * the timer is tickless: S mode asks (with the SBI_SET_TIMER ecall) for an interrupt at its
+ * next deadline only, and mtimecmp is programmed for that (or for the next sample of the
+ * profiler, if it comes first). nothing interrupts an idle hart that has no deadline.
+ */
+
+#include "kernel/riscv.h"
+#include "kernel/config.h"
+#include "kernel/profile.h"
+#include "util/functions.h"
+#include "spike_interface/spike_utils.h"
+
+// g_itrframe is defined in kernel/machine/minit.c, it holds the registers of the trap.
+extern riscv_regs g_itrframe;
+
+// the time (in mtime units) S mode has asked to be interrupted at, -1 for never
+static uint64 s_deadline = -1;
+// the time of the next profiler sample
+static uint64 prof_next = 0;
+
+//
+// program mtimecmp for the earliest of the S-mode deadline and the next profiler sample.
+//
+static void program_timer(int cpuid) {
+  uint64 next = s_deadline;
+  if (g_profiling) next = MIN(next, prof_next);
+  *(uint64*)CLINT_MTIMECMP(cpuid) = next;
+}
+
+static void handle_timer() {
+  int cpuid = 0;
+  uint64 now = *(uint64*)CLINT_MTIME;
+
+  if (g_profiling && now >= prof_next) {
+    // the profiler samples the interrupted pc, mode and callers every PROFILE_INTERVAL.
+    // profile_sample() is defined in kernel/profile.c
+    profile_sample(cpuid, read_csr(mepc), (read_csr(mstatus) & MSTATUS_MPP_MASK) >> 11,
+                   g_itrframe.sp, g_itrframe.s0);
+    prof_next = MAX(prof_next + PROFILE_INTERVAL, now + 1);
+  }
+
+  if (now >= s_deadline) {
+    s_deadline = -1;
+    // setup a soft interrupt in sip (S-mode Interrupt Pending) to be handled in S-mode
+    write_csr(sip, SIP_SSIP);
+  }
+  program_timer(cpuid);
+}
+
+//
+// handle an ecall from S mode. the only call is SBI_SET_TIMER.
+//
+static void handle_sbi_call() {
+  if (g_itrframe.a7 != SBI_SET_TIMER) panic("unknown call %ld from S mode.\n", g_itrframe.a7);
+  s_deadline = g_itrframe.a0;
+  program_timer(0);
+  // skip the ecall instruction
+  write_csr(mepc, read_csr(mepc) + 4);
+}
+
+//
+// handle_mtrap calls a handling function according to the type of a machine mode interrupt (trap).
+//
+void handle_mtrap() {
+  uint64 mcause = read_csr(mcause);
+  switch (mcause) {
+    case CAUSE_MTIMER:
+      handle_timer();
+      break;
+    case CAUSE_SUPERVISOR_ECALL:
+      handle_sbi_call();
+      break;
+    default:
+      sprint("machine trap(): unexpected mscause %p\n", mcause);
+      sprint("            mepc=%p mtval=%p\n", read_csr(mepc), read_csr(mtval));
+      panic( "unexpected exception happened in M-mode.\n" );
+      break;
+  }
+}
@@ -0,0 +1,444 @@
+/*
+ * mmap() of host files (and of the files in the initrd).
+ *
+ * a mapping only records which range of the file it covers. a page is filled from the file
+ * when the app first touches it, i.e., in the page fault handler, so a scan of a large file
+ * only costs the pages it actually reads. the page is read from the host straight into the
+ * physical page that gets mapped, without going through a kernel buffer.
+ *
+ * read-only mappings never write their pages, so all read-only mappings of the same page of
+ * a file (in any process) share one physical page. shared pages are found by the identity
+ * of the file and the index of the page in a hash table, and are freed when their last
+ * mapping goes away. once the file is written, its shared pages are taken off the hash
+ * table (see mmap_invalidate()): the mappings that have them keep them, new ones read the
+ * file again.
+ *
+ * the heap of a process (grown and shrunk by brk) is anonymous memory, whose pages are
+ * also allocated (and zeroed) when they are first touched.
+ *
+ * the last part of this file contains the helpers that the kernel uses to access user
+ * memory, which fault in mmap() and heap pages the same way.
+ */
+
+#include "mmap.h"
+#include "process.h"
+#include "proc_file.h"
+#include "vmm.h"
+#include "pmm.h"
+#include "string.h"
+#include "util/functions.h"
+#include "spike_interface/spike_utils.h"
+
+typedef struct shared_page_t {
+  uint64 dev, ino;  // identity of the file
+  uint64 index;     // index of the page in the file
+  uint64 pa;
+  uint32 refcnt;    // number of mappings of the page
+  int stale;        // the file was written since the page was read, it is not hashed
+  // next page in the same hash bucket, in the list of stale pages, or in the free list
+  struct shared_page_t *next;
+} shared_page;
+
+#define SHARED_INO_FILTER 256
+
+static shared_page shared_pages[MAX_SHARED_PAGES];
+static shared_page *shared_hash[SHARED_PAGE_HASH_SIZE];
+// the pages taken off the hash table by mmap_invalidate(), still mapped
+static shared_page *stale_shared;
+// released entries, and the number of entries of shared_pages that were ever used
+static shared_page *free_shared;
+static int nused_shared;
+// number of hashed pages whose (dev, ino) falls in each slot, to make invalidation cheap
+static uint16 ino_filter[SHARED_INO_FILTER];
+
+static shared_page **bucket_of(uint64 dev, uint64 ino, uint64 index) {
+  uint64 h = (ino * 0x9E3779B97F4A7C15ULL) ^ (dev * 0xC2B2AE3D27D4EB4FULL) ^
+             (index * 0x165667B19E3779F9ULL);
+  return &shared_hash[(h >> 32) % SHARED_PAGE_HASH_SIZE];
+}
+
+static uint16 *filter_of(uint64 dev, uint64 ino) {
+  uint64 h = (ino * 0x9E3779B97F4A7C15ULL) ^ (dev * 0xC2B2AE3D27D4EB4FULL);
+  return &ino_filter[(h >> 40) % SHARED_INO_FILTER];
+}
+
+//
+// allocate a page, and fill it with the page index of the file mapped by area a. the part
+// beyond the end of file reads as zeros.
+//
+static void *new_file_page(mmap_area *a, uint64 index) {
+  // the part of the page that is not read stays zero.
+  void *pa = alloc_zeroed_page();
+  if (!pa) return NULL;
+
+  if (spike_file_pread_direct(a->f, pa, PGSIZE, index * PGSIZE) < 0) {
+    free_page(pa);
+    return NULL;
+  }
+  return pa;
+}
+
+//
+// returns the shared page holding page index of the file mapped by a, and takes a
+// reference to it. returns NULL if the page can not be shared (e.g., the table is full).
+//
+static void *get_shared_page(mmap_area *a, uint64 index) {
+  shared_page **b = bucket_of(a->dev, a->ino, index);
+  for (shared_page *sp = *b; sp; sp = sp->next) {
+    if (sp->index == index && sp->ino == a->ino && sp->dev == a->dev) {
+      sp->refcnt++;
+      return (void *)sp->pa;
+    }
+  }
+
+  shared_page *sp = free_shared;
+  if (sp) free_shared = sp->next;
+  else if (nused_shared < MAX_SHARED_PAGES) sp = &shared_pages[nused_shared++];
+  else return NULL;
+
+  void *pa = new_file_page(a, index);
+  if (!pa) {
+    sp->next = free_shared;
+    free_shared = sp;
+    return NULL;
+  }
+
+  sp->dev = a->dev;
+  sp->ino = a->ino;
+  sp->index = index;
+  sp->pa = (uint64)pa;
+  sp->refcnt = 1;
+  sp->stale = 0;
+  sp->next = *b;
+  *b = sp;
+  (*filter_of(sp->dev, sp->ino))++;
+  return pa;
+}
+
+//
+// the file (dev, ino) has been written: take its shared pages off the hash table, so that
+// new mappings do not get the stale contents. the mappings that have the pages keep them.
+// called by the spike file interface (spike_interface/spike_file.c) on every host write.
+//
+void mmap_invalidate(uint64 dev, uint64 ino) {
+  uint16 *filter = filter_of(dev, ino);
+  for (int i = 0; *filter && i < nused_shared; i++) {
+    shared_page *sp = &shared_pages[i];
+    if (sp->refcnt == 0 || sp->stale || sp->dev != dev || sp->ino != ino) continue;
+
+    shared_page **pp = bucket_of(dev, ino, sp->index);
+    while (*pp != sp) pp = &(*pp)->next;
+    *pp = sp->next;
+    sp->stale = 1;
+    sp->next = stale_shared;
+    stale_shared = sp;
+    (*filter)--;
+  }
+}
+
+// drop a reference to the shared page *pp, and release it (unlinking it from the list
+// *pp is in) once nothing maps it.
+static void put_shared(shared_page **pp) {
+  shared_page *sp = *pp;
+  if (--sp->refcnt > 0) return;
+
+  *pp = sp->next;
+  if (!sp->stale) (*filter_of(sp->dev, sp->ino))--;
+  sp->next = free_shared;
+  free_shared = sp;
+  free_page((void *)sp->pa);
+}
+
+//
+// drop a mapping of the page pa, which holds page index of the file mapped by a. the page
+// is freed once nothing maps it.
+//
+static void put_page(mmap_area *a, uint64 index, uint64 pa) {
+  if (a->shared) {
+    for (shared_page **pp = bucket_of(a->dev, a->ino, index); *pp; pp = &(*pp)->next) {
+      if ((*pp)->pa != pa) continue;
+      put_shared(pp);
+      return;
+    }
+    for (shared_page **pp = &stale_shared; *pp; pp = &(*pp)->next) {
+      if ((*pp)->pa != pa) continue;
+      put_shared(pp);
+      return;
+    }
+  }
+  // a private page, or a page of a read-only mapping that could not be shared.
+  free_page((void *)pa);
+}
+
+static mmap_area *find_area(mmap_management *mm, uint64 va) {
+  for (int i = 0; i < mm->nareas; i++)
+    if (va >= mm->areas[i].start && va < mm->areas[i].end) return &mm->areas[i];
+  return NULL;
+}
+
+void init_mmap_management(mmap_management *mm) {
+  mm->nareas = 0;
+  mm->next_va = USER_MMAP_START;
+}
+
+//
+// map length bytes of the file opened under descriptor fd, starting from offset (which must
+// be page aligned). the hint addr is ignored, mappings are placed one after another from
+// USER_MMAP_START. returns the address of the mapping, or MAP_FAILED.
+//
+uint64 do_mmap(uint64 addr, uint64 length, int prot, int flags, int fd, uint64 offset) {
+  mmap_management *mm = &current->mmaps;
+  spike_file_t *f = get_opened_file(fd);
+  if (!f || length == 0 || offset % PGSIZE != 0) return MAP_FAILED;
+
+  int type = flags & (MAP_SHARED | MAP_PRIVATE);
+  if (type != MAP_SHARED && type != MAP_PRIVATE) return MAP_FAILED;
+  // pages of writable shared mappings would have to be written back to the host, which is
+  // not supported.
+  if (type == MAP_SHARED && (prot & PROT_WRITE)) return MAP_FAILED;
+  if (mm->nareas == MAX_MMAP_AREAS) return MAP_FAILED;
+
+  uint64 dev, ino;
+  if (spike_file_identity(f, &dev, &ino) != 0) return MAP_FAILED;
+
+  length = ROUNDUP(length, PGSIZE);
+  if (mm->next_va + length > current->stack_limit - USER_STACK_GUARD) return MAP_FAILED;
+
+  mmap_area *a = &mm->areas[mm->nareas++];
+  a->start = mm->next_va;
+  a->end = a->start + length;
+  a->prot = prot;
+  a->flags = flags;
+  a->f = f;
+  a->offset = offset;
+  a->dev = dev;
+  a->ino = ino;
+  a->shared = !(prot & PROT_WRITE);
+  // the mapping keeps the file open, even if the app closes fd.
+  spike_file_incref(f);
+
+  mm->next_va = a->end;
+  return a->start;
+}
+
+//
+// remove mapping a of process p, and release its pages.
+//
+static void unmap_area(process *p, mmap_area *a) {
+  for (uint64 va = a->start; va < a->end; va += PGSIZE) {
+    pte_t *pte = page_walk(p->pagetable, va, 0);
+    if (!pte || !(*pte & PTE_V)) continue;
+    put_page(a, (a->offset + va - a->start) / PGSIZE, PTE2PA(*pte));
+    *pte = 0;
+  }
+  flush_tlb();
+
+  spike_file_decref(a->f);
+  *a = p->mmaps.areas[--p->mmaps.nareas];
+}
+
+//
+// remove the mapping at addr. only whole mappings (as returned by do_mmap) can be removed.
+//
+int do_munmap(uint64 addr, uint64 length) {
+  mmap_area *a = find_area(&current->mmaps, addr);
+  if (!a || a->start != addr || a->end - a->start != ROUNDUP(length, PGSIZE)) return -1;
+
+  unmap_area(current, a);
+  return 0;
+}
+
+//
+// give the child of a fork the mappings of its parent. the pages of private mappings are
+// copied along with the rest of the memory of the parent, the ones of shared mappings are
+// not: the child finds them in the table of shared pages when it touches them.
+//
+void fork_mmap(process *parent, process *child) {
+  child->mmaps = parent->mmaps;
+  for (int i = 0; i < child->mmaps.nareas; i++) spike_file_incref(child->mmaps.areas[i].f);
+}
+
+//
+// remove all mappings of process p, which is exiting.
+//
+void exit_mmap(process *p) {
+  while (p->mmaps.nareas > 0) unmap_area(p, &p->mmaps.areas[0]);
+}
+
+//
+// returns 1 if va of process p belongs to a shared (i.e., read-only) mapping.
+//
+int mmap_is_shared(process *p, uint64 va) {
+  mmap_area *a = find_area(&p->mmaps, va);
+  return a && a->shared;
+}
+
+//
+// handle a page fault of process p at address va. fills and maps the page if va belongs
+// to a mapping of p that allows the access. returns -1 for an illegal access.
+//
+int handle_mmap_fault(process *p, uint64 va, int write) {
+  mmap_area *a = find_area(&p->mmaps, va);
+  if (!a || (a->prot & (PROT_READ | PROT_WRITE | PROT_EXEC)) == 0) return -1;
+  if (write && !(a->prot & PROT_WRITE)) return -1;
+
+  uint64 page_va = ROUNDDOWN(va, PGSIZE);
+  pte_t *pte = page_walk(p->pagetable, page_va, 0);
+  // the page is there, so the fault is a violation of its protection.
+  if (pte && (*pte & PTE_V)) return -1;
+
+  uint64 index = (a->offset + page_va - a->start) / PGSIZE;
+  void *pa = a->shared ? get_shared_page(a, index) : NULL;
+  if (!pa) pa = new_file_page(a, index);
+  if (!pa) return -1;
+
+  user_vm_map(p->pagetable, page_va, PGSIZE, (uint64)pa, prot_to_type(a->prot, 1));
+  return 0;
+}
+
+// map a zeroed (read/write) page at va of process p, where nothing is mapped yet.
+static int map_zero_page(process *p, uint64 va) {
+  uint64 page_va = ROUNDDOWN(va, PGSIZE);
+  pte_t *pte = page_walk(p->pagetable, page_va, 0);
+  if (pte && (*pte & PTE_V)) return -1;
+
+  void *pa = alloc_zeroed_page();
+  if (!pa) return -1;
+  user_vm_map(p->pagetable, page_va, PGSIZE, (uint64)pa,
+              prot_to_type(PROT_READ | PROT_WRITE, 1));
+  return 0;
+}
+
+/* --- the heap --- */
+//
+// move the end of the heap (the "program break") of current process to addr. the pages
+// above the new end are released, and the ones below it are allocated when touched.
+// returns the new end, or the current one if addr is 0. returns -1 if addr is out of the
+// range of the heap.
+//
+uint64 do_brk(uint64 addr) {
+  if (addr == 0) return current->heap_end;
+  if (addr < current->heap_start || addr > USER_SHM_START) return -1;
+
+  uint64 old_end = ROUNDUP(current->heap_end, PGSIZE), new_end = ROUNDUP(addr, PGSIZE);
+  if (new_end < old_end) user_vm_unmap(current->pagetable, new_end, old_end - new_end, 1);
+
+  current->heap_end = addr;
+  return addr;
+}
+
+//
+// handle a page fault of process p at address va of its heap, by mapping a zeroed page.
+// returns -1 if va is not in the heap.
+//
+int handle_heap_fault(process *p, uint64 va, int write) {
+  if (va < p->heap_start || va >= p->heap_end) return -1;
+  return map_zero_page(p, va);
+}
+
+/* --- the stack --- */
+//
+// handle a page fault of process p at address va of its stack, by mapping a zeroed page.
+// the stack may grow down to p->stack_limit, an access below it (e.g., in the guard gap)
+// is an overflow. returns -1 if va is not in the stack.
+//
+int handle_stack_fault(process *p, uint64 va, int write) {
+  if (va < p->stack_limit || va >= USER_STACK_TOP) return -1;
+  return map_zero_page(p, va);
+}
+
+//
+// handle a page fault of process p at address va, for a write if write != 0: fill in the
+// page if va belongs to a mapping, to the heap or to the stack of p. returns -1 for an
+// illegal access.
+//
+int handle_user_fault(process *p, uint64 va, int write) {
+  if (handle_mmap_fault(p, va, write) == 0) return 0;
+  if (handle_heap_fault(p, va, write) == 0) return 0;
+  return handle_stack_fault(p, va, write);
+}
+
+/* --- accessing user memory from the kernel --- */
+//
+// translate the address va of process p, for a write if write != 0. a page of a mapping
+// (or of the heap, or of the stack) that has not been touched yet is faulted in. returns NULL if p may not access va.
+//
+void *user_va_to_pa_fault(process *p, uint64 va, int write) {
+  if (va >= MAXVA) return NULL;
+
+  // superpages (of shared memory segments) are always there.
+  pte_t *huge = superpage_walk(p->pagetable, va);
+  if (huge) {
+    if (!(*huge & PTE_U) || (write && !(*huge & PTE_W))) return NULL;
+    return (void *)(PTE2PA(*huge) + (va & (SUPERPAGE_SIZE - 1)));
+  }
+
+  pte_t *pte = page_walk(p->pagetable, va, 0);
+  if (!pte || !(*pte & PTE_V)) {
+    if (handle_user_fault(p, va, write) != 0) return NULL;
+    pte = page_walk(p->pagetable, va, 0);
+  }
+  if (!(*pte & PTE_U) || (write && !(*pte & PTE_W))) return NULL;
+
+  return (void *)(PTE2PA(*pte) + (va & (PGSIZE - 1)));
+}
+
+//
+// map page pa at va (page aligned) of process p, in place of the page mapped there, which
+// is returned. only a page that p alone owns and may write can be exchanged (e.g., not the
+// console output ring, which the kernel reads): returns NULL if va holds no such page.
+//
+void *user_page_exchange(process *p, uint64 va, void *pa) {
+  pte_t *pte = page_walk(p->pagetable, va, 0);
+  if (!pte || (*pte & (PTE_V | PTE_U | PTE_W)) != (PTE_V | PTE_U | PTE_W)) return NULL;
+  if (*pte & PTE_SHARED) return NULL;
+  if (va == USER_PRINT_RING || mmap_is_shared(p, va)) return NULL;
+
+  void *old = (void *)PTE2PA(*pte);
+  *pte = PA2PTE(pa) | PTE_FLAGS(*pte);
+  flush_tlb();
+  return old;
+}
+
+//
+// copy n bytes from the kernel (src) to address dst of process p. returns 0, or -1 if a
+// page of the destination is not writable by p.
+//
+int copy_to_user(process *p, uint64 dst, const void *src, uint64 n) {
+  for (uint64 done = 0, cnt; done < n; done += cnt) {
+    char *pa = user_va_to_pa_fault(p, dst + done, 1);
+    if (!pa) return -1;
+    cnt = MIN(n - done, PGSIZE - ((dst + done) & (PGSIZE - 1)));
+    memcpy(pa, (const char *)src + done, cnt);
+  }
+  return 0;
+}
+
+//
+// copy n bytes from address src of process p to the kernel (dst). returns 0, or -1 if a
+// page of the source is not accessible.
+//
+int copy_from_user(process *p, void *dst, uint64 src, uint64 n) {
+  for (uint64 done = 0, cnt; done < n; done += cnt) {
+    const char *pa = user_va_to_pa_fault(p, src + done, 0);
+    if (!pa) return -1;
+    cnt = MIN(n - done, PGSIZE - ((src + done) & (PGSIZE - 1)));
+    memcpy((char *)dst + done, pa, cnt);
+  }
+  return 0;
+}
+
+//
+// copy the string at address src of process p to dst, which holds n bytes. returns the
+// length of the string, or -1 if it is not accessible or does not fit.
+//
+int strncpy_from_user(process *p, char *dst, uint64 src, uint64 n) {
+  for (uint64 done = 0; done < n;) {
+    const char *pa = user_va_to_pa_fault(p, src + done, 0);
+    if (!pa) return -1;
+    uint64 end = MIN(n, done + PGSIZE - ((src + done) & (PGSIZE - 1)));
+    for (; done < end; done++, pa++)
+      if ((dst[done] = *pa) == '\0') return done;
+  }
+  return -1;
+}
@@ -0,0 +1,57 @@
+#ifndef _MMAP_H_
+#define _MMAP_H_
+
+#include "util/types.h"
+#include "spike_interface/spike_file.h"
+
+// flags of mmap() (Linux values)
+#define MAP_SHARED 0x01
+#define MAP_PRIVATE 0x02
+#define MAP_FAILED ((uint64)-1)
+
+// maximum number of mappings a process can have at the same time
+#define MAX_MMAP_AREAS 32
+// maximum number of file pages shared by read-only mappings, and slots of their hash table
+#define MAX_SHARED_PAGES 4096
+#define SHARED_PAGE_HASH_SIZE 1024
+
+// a range of the user address space that maps (part of) a file. pages are filled when
+// they are first touched.
+typedef struct mmap_area_t {
+  uint64 start, end;  // [start, end), page aligned
+  int prot, flags;
+  spike_file_t *f;    // the mapped file, holding a reference
+  uint64 offset;      // file offset mapped at start, page aligned
+  uint64 dev, ino;    // identity of the file, keys of the shared pages
+  int shared;         // read-only mapping, its pages are shared with other such mappings
+} mmap_area;
+
+typedef struct mmap_management_t {
+  mmap_area areas[MAX_MMAP_AREAS];
+  int nareas;
+  uint64 next_va;  // where the next mapping is placed
+} mmap_management;
+
+struct process_t;
+
+void init_mmap_management(mmap_management *mm);
+uint64 do_mmap(uint64 addr, uint64 length, int prot, int flags, int fd, uint64 offset);
+int do_munmap(uint64 addr, uint64 length);
+int handle_mmap_fault(struct process_t *p, uint64 va, int write);
+void fork_mmap(struct process_t *parent, struct process_t *child);
+void exit_mmap(struct process_t *p);
+int mmap_is_shared(struct process_t *p, uint64 va);
+void mmap_invalidate(uint64 dev, uint64 ino);
+
+uint64 do_brk(uint64 addr);
+int handle_heap_fault(struct process_t *p, uint64 va, int write);
+int handle_stack_fault(struct process_t *p, uint64 va, int write);
+int handle_user_fault(struct process_t *p, uint64 va, int write);
+
+void *user_va_to_pa_fault(struct process_t *p, uint64 va, int write);
+void *user_page_exchange(struct process_t *p, uint64 va, void *pa);
+int copy_to_user(struct process_t *p, uint64 dst, const void *src, uint64 n);
+int copy_from_user(struct process_t *p, void *dst, uint64 src, uint64 n);
+int strncpy_from_user(struct process_t *p, char *dst, uint64 src, uint64 n);
+
+#endif
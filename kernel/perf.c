@@ -0,0 +1,85 @@
+/*
+ * per-process virtualization of the hardware performance counters.
+ *
+ * the counters are free-running and shared by all processes. the kernel takes a snapshot
+ * of the started counters of a process whenever it enters user mode (perf_switch_in), and
+ * adds what they advanced to the counts of the process when it traps (perf_switch_out). so
+ * the counts of a process cover its own user mode execution only, and neither the kernel
+ * nor other processes that run in between.
+ */
+
+#include "perf.h"
+#include "riscv.h"
+#include "config.h"
+#include "process.h"
+
+// the events of the hpm counters, 0 for a counter not backed by any (see kernel/config.h)
+static const uint64 hpm_events[] = {
+  [PERF_HPM3] = HPM_EVENT3,
+  [PERF_HPM4] = HPM_EVENT4,
+  [PERF_HPM5] = HPM_EVENT5,
+  [PERF_HPM6] = HPM_EVENT6,
+};
+
+// the csr number must be an immediate, hence the switch.
+static uint64 read_counter(int counter) {
+  switch (counter) {
+    case PERF_CYCLE:
+      return read_csr(cycle);
+    case PERF_INSTRET:
+      return read_csr(instret);
+    case PERF_HPM3:
+      return read_csr(hpmcounter3);
+    case PERF_HPM4:
+      return read_csr(hpmcounter4);
+    case PERF_HPM5:
+      return read_csr(hpmcounter5);
+    case PERF_HPM6:
+      return read_csr(hpmcounter6);
+    default:
+      return 0;
+  }
+}
+
+//
+// called right before returning to user mode.
+//
+void perf_switch_in(perf_ctx *ctx) {
+  for (int i = 0; ctx->running >> i; i++)
+    if (ctx->running & (1UL << i)) ctx->base[i] = read_counter(i);
+}
+
+//
+// called right after trapping from user mode.
+//
+void perf_switch_out(perf_ctx *ctx) {
+  for (int i = 0; ctx->running >> i; i++)
+    if (ctx->running & (1UL << i)) ctx->count[i] += read_counter(i) - ctx->base[i];
+}
+
+//
+// the counter operations of the current process. note, the counts are up to date here, as
+// perf_switch_out() has run when the process trapped into the kernel. returns -1 for a
+// counter that does not exist, or is an hpm counter without an event.
+//
+long do_perf(int op, int counter) {
+  if (counter < 0 || counter >= NR_PERF_COUNTERS) return -1;
+  if (counter >= PERF_HPM3 && hpm_events[counter] == 0) return -1;
+  perf_ctx *ctx = &current->perf;
+
+  switch (op) {
+    case PERF_OP_START:
+      ctx->running |= 1UL << counter;
+      return 0;
+    case PERF_OP_STOP:
+      ctx->running &= ~(1UL << counter);
+      return 0;
+    case PERF_OP_READ:
+      return ctx->count[counter];
+    case PERF_OP_RESET:
+      ctx->count[counter] = 0;
+      return 0;
+    default:
+      return -1;
+  }
+}
@@ -0,0 +1,18 @@
+#ifndef _PERF_H_
+#define _PERF_H_
+
+#include "util/types.h"
+#include "util/perf_events.h"
+
+// per-process state of the virtualized counters
+typedef struct perf_ctx_t {
+  uint64 running;                   // bitmap of the started counters
+  uint64 count[NR_PERF_COUNTERS];   // counts accumulated until the last trap
+  uint64 base[NR_PERF_COUNTERS];    // raw counter values at the last entry to user mode
+} perf_ctx;
+
+void perf_switch_in(perf_ctx *ctx);
+void perf_switch_out(perf_ctx *ctx);
+long do_perf(int op, int counter);
+
+#endif
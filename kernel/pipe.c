@@ -0,0 +1,208 @@
+/*
+ * pipes between processes.
+ *
+ * the data in a pipe is kept in a ring of (up to PIPE_NBUFS) whole pages, rather than in
+ * a ring of bytes, so that a page of data can change hands without being copied:
+ *  - pipe_write() with move set takes the pages of a page-aligned buffer of the writer out
+ *    of its address space, and puts them into the ring as they are (the writer is given
+ *    zeroed pages in their place), i.e., vmsplice() with gifted pages;
+ *  - pipe_read() into a page-aligned buffer maps a full page of the ring in place of the
+ *    page of the reader, instead of copying it.
+ * other transfers copy, into the last page of the ring as long as it has room.
+ *
+ * the two ends are files of their own (SPIKE_FILE_PIPE). readers sleep while the pipe is
+ * empty and writers while it is full, until the other side makes progress or goes away.
+ */
+
+#include "pipe.h"
+#include "process.h"
+#include "mmap.h"
+#include "pmm.h"
+#include "string.h"
+#include "util/functions.h"
+#include "spike_interface/spike_utils.h"
+
+//
+// create a pipe, and return the files of its read and write ends, which hold one
+// descriptor reference each. returns -1 if the memory is used up.
+//
+int pipe_create(spike_file_t **rfile, spike_file_t **wfile) {
+  pipe_t *p = (pipe_t *)alloc_page();
+  if (!p) return -1;
+  memset(p, 0, sizeof(pipe_t));
+
+  p->rfile = spike_file_alloc(SPIKE_FILE_PIPE, p);
+  if (IS_ERR_VALUE(p->rfile)) goto fail;
+  p->wfile = spike_file_alloc(SPIKE_FILE_PIPE, p);
+  if (IS_ERR_VALUE(p->wfile)) {
+    spike_file_decref(p->rfile);
+    spike_file_decref(p->rfile);
+    goto fail;
+  }
+
+  // a new file comes with a reference for its opener and one for its first descriptor,
+  // see do_open() in kernel/proc_file.c
+  spike_file_decref(p->rfile);
+  spike_file_decref(p->wfile);
+  p->readers = p->writers = 1;
+  *rfile = p->rfile;
+  *wfile = p->wfile;
+  return 0;
+
+fail:
+  free_page(p);
+  return -1;
+}
+
+//
+// f, an end of a pipe, has got one more descriptor (e.g., in the child of a fork).
+//
+void pipe_dup(spike_file_t *f) {
+  pipe_t *p = f->priv;
+  if (f == p->rfile) p->readers++;
+  else p->writers++;
+}
+
+//
+// a descriptor of f, an end of a pipe, is closed. the other side learns that the end is
+// gone with its last descriptor, and the pipe goes away with the last descriptor of both.
+//
+void pipe_close(spike_file_t *f) {
+  pipe_t *p = f->priv;
+  if (f == p->rfile) {
+    if (--p->readers == 0) wakeup(&p->wwait);
+  } else {
+    if (--p->writers == 0) wakeup(&p->rwait);
+  }
+  if (p->readers > 0 || p->writers > 0) return;
+
+  for (uint32 i = 0; i < p->nbufs; i++) free_page(p->bufs[(p->head + i) % PIPE_NBUFS].page);
+  free_page(p);
+}
+
+//
+// read up to count bytes from the pipe of f into buf. sleeps while the pipe is empty, and
+// returns 0 once it is empty and has no writer left.
+//
+ssize_t pipe_read(spike_file_t *f, char *buf, uint64 count) {
+  pipe_t *p = f->priv;
+  if (f != p->rfile) return -1;
+  if (count == 0) return 0;
+  if (p->nbufs == 0) {
+    if (p->writers == 0) return 0;
+    // sleep_on() is defined in kernel/sched.c, and never returns.
+    sleep_on(&p->rwait);
+  }
+
+  uint64 done = 0;
+  while (done < count && p->nbufs > 0) {
+    pipe_buf *b = &p->bufs[p->head];
+    uint64 va = (uint64)buf + done;
+    uint64 n = MIN(count - done, b->len);
+    void *old = NULL;
+
+    if (b->off == 0 && b->len == PGSIZE && n == PGSIZE && va % PGSIZE == 0 &&
+        (old = user_page_exchange(current, va, b->page)) != NULL) {
+      // the page of the ring now belongs to the reader, its old page goes to the pipe.
+      b->page = old;
+    } else if (copy_to_user(current, va, b->page + b->off, n) != 0) {
+      if (done == 0) return -1;
+      break;
+    }
+
+    b->off += n;
+    b->len -= n;
+    done += n;
+    if (b->len == 0) {
+      free_page(b->page);
+      p->head = (p->head + 1) % PIPE_NBUFS;
+      p->nbufs--;
+    }
+  }
+
+  wakeup(&p->wwait);
+  return done;
+}
+
+//
+// the last page of the ring of p, if it has room left, or a new one. returns NULL if the
+// ring is full, or the memory is used up.
+//
+static pipe_buf *tail_buf(pipe_t *p) {
+  if (p->nbufs > 0) {
+    pipe_buf *b = &p->bufs[(p->head + p->nbufs - 1) % PIPE_NBUFS];
+    if (b->off + b->len < PGSIZE) return b;
+  }
+  if (p->nbufs == PIPE_NBUFS) return NULL;
+
+  char *page = alloc_page();
+  if (!page) return NULL;
+  pipe_buf *b = &p->bufs[(p->head + p->nbufs++) % PIPE_NBUFS];
+  b->page = page;
+  b->off = b->len = 0;
+  return b;
+}
+
+//
+// move the page at va (page aligned) of current process into the ring of p, and give the
+// process a zeroed page in its place. returns -1 if the page can not be moved.
+//
+static int move_page(pipe_t *p, uint64 va) {
+  char *fresh = alloc_zeroed_page();
+  if (!fresh) return -1;
+
+  char *page = user_page_exchange(current, va, fresh);
+  if (!page) {
+    free_page(fresh);
+    return -1;
+  }
+
+  pipe_buf *b = &p->bufs[(p->head + p->nbufs++) % PIPE_NBUFS];
+  b->page = page;
+  b->off = 0;
+  b->len = PGSIZE;
+  return 0;
+}
+
+//
+// write up to count bytes from buf into the pipe of f. with move set, the whole pages of
+// buf are moved into the pipe, rather than copied, and read as zeros afterwards. sleeps
+// while the pipe is full. returns the number of bytes written, which is less than count
+// if the pipe fills up, or -1 if the pipe has no reader left.
+//
+ssize_t pipe_write(spike_file_t *f, char *buf, uint64 count, int move) {
+  pipe_t *p = f->priv;
+  if (f != p->wfile || p->readers == 0) return -1;
+  if (count == 0) return 0;
+
+  uint64 done = 0;
+  while (done < count) {
+    uint64 va = (uint64)buf + done;
+    if (move && va % PGSIZE == 0 && count - done >= PGSIZE && p->nbufs < PIPE_NBUFS &&
+        move_page(p, va) == 0) {
+      done += PGSIZE;
+      continue;
+    }
+
+    pipe_buf *b = tail_buf(p);
+    if (!b) break;
+    uint64 n = MIN(count - done, PGSIZE - b->off - b->len);
+    if (copy_from_user(current, b->page + b->off + b->len, va, n) != 0) {
+      // drop the page just taken for the copy, a reader must not find it empty.
+      if (b->off + b->len == 0) {
+        free_page(b->page);
+        p->nbufs--;
+      }
+      if (done == 0) return -1;
+      break;
+    }
+    b->len += n;
+    done += n;
+  }
+
+  // nothing fits, wait for the readers to make room. sleep_on() never returns.
+  if (done == 0) sleep_on(&p->wwait);
+
+  wakeup(&p->rwait);
+  return done;
+}
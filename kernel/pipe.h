@@ -0,0 +1,34 @@
+#ifndef _PIPE_H_
+#define _PIPE_H_
+
+#include "util/types.h"
+#include "sched.h"
+#include "spike_interface/spike_file.h"
+
+// capacity of a pipe, in pages
+#define PIPE_NBUFS 16
+
+// a page of data in the ring of a pipe. the bytes [off, off + len) of page are unread.
+typedef struct pipe_buf_t {
+  char *page;
+  uint32 off, len;
+} pipe_buf;
+
+typedef struct pipe_t {
+  // ring of pages: nbufs of them, the oldest at bufs[head]
+  pipe_buf bufs[PIPE_NBUFS];
+  uint32 head, nbufs;
+  // the files of the two ends, and the number of descriptors (of all processes) of each
+  spike_file_t *rfile, *wfile;
+  int readers, writers;
+  // processes waiting for data, and for room
+  wait_queue rwait, wwait;
+} pipe_t;
+
+int pipe_create(spike_file_t **rfile, spike_file_t **wfile);
+void pipe_dup(spike_file_t *f);
+void pipe_close(spike_file_t *f);
+ssize_t pipe_read(spike_file_t *f, char *buf, uint64 count);
+ssize_t pipe_write(spike_file_t *f, char *buf, uint64 count, int move);
+
+#endif
@@ -0,0 +1,241 @@
+/*
+ * physical memory manager. the physical memory between the end of the PKE kernel and
+ * PHYS_TOP is cut into pages. pages are handed out in the ascending order of addresses,
+ * from a frontier below which all pages have been allocated at least once, and the pages
+ * freed since are kept in a list (and reused first). the memory in use thus always ends
+ * at the frontier, e.g., for a boot snapshot (kernel/snapshot.c).
+ *
+ * a pool of up to ZEROED_POOL_PAGES pages is zeroed ahead of time, while the hart is idle,
+ * so that a page fault or the elf loader gets a zeroed page without zeroing it inline.
+ */
+
+#include "pmm.h"
+#include "util/functions.h"
+#include "riscv.h"
+#include "config.h"
+#include "string.h"
+#include "spike_interface/spike_utils.h"
+
+// _end is defined in kernel/kernel.lds, it marks the ending (virtual) address of PKE kernel
+extern char _end[];
+// g_mem_size is defined in spike_interface/spike_memory.c, it indicates the size of our
+// (emulated) spike machine. g_mem_size's value is obtained when initializing HTIF.
+extern uint64 g_mem_size;
+
+static uint64 free_mem_start_addr;  //beginning address of free memory
+static uint64 free_mem_end_addr;    //end address of free memory (not included)
+static uint64 free_mem_frontier;    //pages from here on have never been allocated
+
+typedef struct node {
+  struct node *next;
+} list_node;
+
+// g_free_mem_list is the head of the list of free physical memory pages
+static list_node g_free_mem_list;
+
+// the pool of zeroed pages. they are kept in an array rather than linked through the pages
+// (as the free list is), which would dirty them.
+static void *zeroed_pages[ZEROED_POOL_PAGES];
+static int nzeroed;
+
+// pin counts of the pages, indexed by the page number (from DRAM_BASE). PIN_FREED marks a
+// pinned page that was freed, it goes to g_free_mem_list when the last pin is dropped.
+#define PIN_FREED 0x8000
+static uint16 page_pins[PKE_MAX_ALLOWABLE_RAM / PGSIZE];
+
+#define page_index(pa) (((uint64)(pa) - DRAM_BASE) / PGSIZE)
+
+//
+// place a physical page at *pa to the free list of g_free_mem_list (to reclaim the page)
+//
+void free_page(void *pa) {
+  if (((uint64)pa % PGSIZE) != 0 || (uint64)pa < free_mem_start_addr || (uint64)pa >= free_mem_end_addr)
+    panic("free_page 0x%lx \n", pa);
+
+  uint16 *pins = &page_pins[page_index(pa)];
+  if (*pins) {
+    *pins |= PIN_FREED;
+    return;
+  }
+
+  // insert a physical page to g_free_mem_list
+  list_node *n = (list_node *)pa;
+  n->next = g_free_mem_list.next;
+  g_free_mem_list.next = n;
+}
+
+//
+// pin the page pa. pins nest, each one must be dropped by unpin_page().
+//
+void pin_page(void *pa) {
+  if ((uint64)pa < free_mem_start_addr || (uint64)pa >= free_mem_end_addr)
+    panic("pin_page 0x%lx \n", pa);
+  page_pins[page_index(pa)]++;
+}
+
+//
+// drop a pin of the page pa. the page is reclaimed here if it was freed while pinned.
+//
+void unpin_page(void *pa) {
+  uint16 *pins = &page_pins[page_index(pa)];
+  if ((*pins & ~PIN_FREED) == 0) panic("unpin_page 0x%lx \n", pa);
+  if (--*pins == PIN_FREED) {
+    *pins = 0;
+    free_page(pa);
+  }
+}
+
+// take the first free page from g_free_mem_list, or the page at the frontier if the list
+// is empty. returns NULL if there is neither.
+static void *take_free_page(void) {
+  list_node *n = g_free_mem_list.next;
+  if (n) {
+    g_free_mem_list.next = n->next;
+    return (void *)n;
+  }
+
+  // the frontier moves up by one page, so that pages allocated one after another are
+  // usually physically contiguous, which lets a large transfer be done in one piece.
+  if (free_mem_frontier + PGSIZE > free_mem_end_addr) return NULL;
+  free_mem_frontier += PGSIZE;
+  return (void *)(free_mem_frontier - PGSIZE);
+}
+
+//
+// takes a free page, and returns (allocates) it. the pool of zeroed pages is drawn on only
+// when there is no other free page. Allocates only ONE page!
+//
+void *alloc_page(void) {
+  void *pa = take_free_page();
+  if (!pa && nzeroed > 0) pa = zeroed_pages[--nzeroed];
+  return pa;
+}
+
+//
+// zero the page at pa, a cache line (eight 64-bit stores of the zero register) at a time.
+// the stores are written out, lest the compiler turns the loop into a call of memset().
+//
+static void zero_page(void *pa) {
+  for (char *p = pa; p < (char *)pa + PGSIZE; p += 64)
+    asm volatile(
+        "sd zero, 0(%0)\n"
+        "sd zero, 8(%0)\n"
+        "sd zero, 16(%0)\n"
+        "sd zero, 24(%0)\n"
+        "sd zero, 32(%0)\n"
+        "sd zero, 40(%0)\n"
+        "sd zero, 48(%0)\n"
+        "sd zero, 56(%0)\n"
+        :
+        : "r"(p)
+        : "memory");
+}
+
+//
+// allocates a page filled with zeros. it comes from the pool of zeroed pages, and is only
+// zeroed here if the pool has run dry.
+//
+void *alloc_zeroed_page(void) {
+  if (nzeroed > 0) return zeroed_pages[--nzeroed];
+
+  void *pa = take_free_page();
+  if (pa) zero_page(pa);
+  return pa;
+}
+
+// set once the waits for the host may fill the pool, see zero_page_ahead()
+static int zero_ahead = 0;
+
+//
+// let the waits for the host fill the pool of zeroed pages from now on. called before the
+// applications are loaded, once the kernel state is final (a snapshot is saved already).
+//
+void start_zeroing_ahead(void) {
+  zero_ahead = 1;
+}
+
+//
+// zero a page into the pool, unless it is full. called over and over while the hart waits
+// for the host to answer a request (see spike_interface/spike_htif.c), e.g., a read of the
+// elf loader, so that the bss of the application and its first page faults find the pool
+// filled, although the hart has never been idle yet.
+//
+void zero_page_ahead(void) {
+  if (!zero_ahead || nzeroed == ZEROED_POOL_PAGES) return;
+  void *pa = take_free_page();
+  if (!pa) return;
+  zero_page(pa);
+  zeroed_pages[nzeroed++] = pa;
+}
+
+//
+// fill the pool of zeroed pages up. called by the idle loop of schedule(), it stops early
+// once the timer interrupt is pending, i.e., when there may be work to do.
+//
+void refill_zeroed_pages(void) {
+  while (nzeroed < ZEROED_POOL_PAGES && !(read_csr(sip) & SIP_SSIP)) {
+    void *pa = take_free_page();
+    if (!pa) return;
+    zero_page(pa);
+    zeroed_pages[nzeroed++] = pa;
+  }
+}
+
+//
+// allocate n physically contiguous pages, whose start is aligned to align bytes (a power
+// of two), e.g., to back a superpage. they are taken at the frontier, where the memory is
+// contiguous, and the pages skipped for the alignment go to the free list. each of the
+// pages is freed on its own, by free_page().
+//
+void *alloc_pages(uint64 n, uint64 align) {
+  if (n == 1 && align <= PGSIZE) return alloc_page();
+
+  uint64 start = ROUNDUP(free_mem_frontier, MAX(align, PGSIZE));
+  if (start + n * PGSIZE > free_mem_end_addr) return NULL;
+  for (uint64 pa = free_mem_frontier; pa < start; pa += PGSIZE) {
+    free_mem_frontier = pa + PGSIZE;
+    free_page((void *)pa);
+  }
+  free_mem_frontier = start + n * PGSIZE;
+  return (void *)start;
+}
+
+//
+// the end of the memory ever allocated, i.e., the pages in [end of PKE kernel, frontier).
+//
+uint64 pmm_frontier(void) {
+  return free_mem_frontier;
+}
+
+//
+// pmm_init() establishes the list of free physical pages according to available
+// physical memory space.
+//
+void pmm_init() {
+  // start of kernel program segment
+  uint64 g_kernel_start = KERN_BASE;
+  uint64 g_kernel_end = (uint64)&_end;
+
+  uint64 pke_kernel_size = g_kernel_end - g_kernel_start;
+  sprint("PKE kernel start 0x%lx, PKE kernel end: 0x%lx, PKE kernel size: 0x%lx .\n",
+    g_kernel_start, g_kernel_end, pke_kernel_size);
+
+  // free memory starts from the end of PKE kernel and must be page-aligined
+  free_mem_start_addr = ROUNDUP(g_kernel_end , PGSIZE);
+
+  // PKE manages at most PKE_MAX_ALLOWABLE_RAM of the physical memory. the memory above
+  // PHYS_TOP (if any) is left to the initrd.
+  uint64 mem_size = MIN(PKE_MAX_ALLOWABLE_RAM, g_mem_size);
+  if( mem_size < pke_kernel_size )
+    panic( "Error when recomputing physical memory size (g_mem_size).\n" );
+
+  free_mem_end_addr = mem_size + DRAM_BASE;
+  sprint("free physical memory address: [0x%lx, 0x%lx] \n", free_mem_start_addr,
+    free_mem_end_addr - 1);
+
+  sprint("kernel memory manager is initializing ...\n");
+  // all pages are free, and none has been handed out yet.
+  g_free_mem_list.next = 0;
+  free_mem_frontier = free_mem_start_addr;
+  nzeroed = 0;
+}
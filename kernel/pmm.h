@@ -0,0 +1,28 @@
+#ifndef _PMM_H_
+#define _PMM_H_
+
+#include "util/types.h"
+
+// Initialize phisical memeory manager
+void pmm_init();
+// Allocate a free phisical page
+void* alloc_page();
+// Allocate a free phisical page filled with zeros
+void* alloc_zeroed_page();
+// Zero free pages ahead of time, for alloc_zeroed_page() (called while the hart is idle)
+void refill_zeroed_pages();
+// Zero a page ahead of time while waiting for the host, once start_zeroing_ahead() is called
+void start_zeroing_ahead(void);
+void zero_page_ahead(void);
+// Allocate n physically contiguous pages, aligned to align bytes
+void* alloc_pages(uint64 n, uint64 align);
+// Free an allocated page
+void free_page(void* pa);
+// Pin an allocated page, so that it is not reused before it is unpinned (e.g., while the
+// host transfers data to/from it)
+void pin_page(void* pa);
+void unpin_page(void* pa);
+// The end of the physical memory allocated so far
+uint64 pmm_frontier(void);
+
+#endif
@@ -0,0 +1,353 @@
+/*
+ * Interface functions between the file system calls of PKE (i.e., open, read, write, etc.)
+ * and the spike file layer (defined in spike_interface/spike_file.c).
+ *
+ * every process owns a descriptor table (proc_file_management) that maps the descriptors
+ * used by the application to opened spike files.
+ *
+ * the buffers passed by the application are (user) virtual addresses. they are translated,
+ * and the spike file layer transfers data straight to/from the physical pages.
+ */
+
+#include "proc_file.h"
+#include "process.h"
+#include "mmap.h"
+#include "pmm.h"
+#include "sched.h"
+#include "pipe.h"
+#include "vmm.h"
+#include "string.h"
+#include "util/functions.h"
+
+#include "spike_interface/spike_utils.h"
+#include "spike_interface/spike_htif.h"
+
+// the descriptor tables, one for each slot of the process pool.
+static proc_file_management proc_files[NPROC];
+
+// processes blocked on reading the console
+static wait_queue console_readers;
+
+//
+// initialize the descriptor table of process p. descriptors 0, 1 and 2 are bound to the
+// stdin, stdout and stderr of the host.
+//
+proc_file_management *init_proc_file_management(process *p) {
+  proc_file_management *pfiles = &proc_files[p - procs];
+
+  pfiles->fd_table[0] = stdin;
+  pfiles->fd_table[1] = stdout;
+  pfiles->fd_table[2] = stderr;
+
+  // push the descriptors in descending order, so that the lowest one is popped first.
+  pfiles->nfree = 0;
+  for (int fd = MAX_PROC_FILES - 1; fd >= 3; fd--) {
+    pfiles->fd_table[fd] = NULL;
+    pfiles->free_fds[pfiles->nfree++] = fd;
+  }
+
+  return pfiles;
+}
+
+// the console files are shared with the kernel, and are never closed.
+static int is_console(spike_file_t *f) {
+  return f == stdin || f == stdout || f == stderr;
+}
+
+//
+// give the child of a fork the descriptors of its parent, which refer to the same files.
+//
+void fork_proc_files(process *parent, process *child) {
+  proc_file_management *pfiles = child->pfiles;
+  memcpy(pfiles, parent->pfiles, sizeof(proc_file_management));
+
+  for (int fd = 0; fd < MAX_PROC_FILES; fd++) {
+    spike_file_t *f = pfiles->fd_table[fd];
+    if (!f || is_console(f)) continue;
+    spike_file_incref(f);
+    if (f->flags & SPIKE_FILE_PIPE) pipe_dup(f);
+  }
+}
+
+//
+// close all descriptors of process p, which is exiting (and is current).
+//
+void close_proc_files(process *p) {
+  for (int fd = 0; fd < MAX_PROC_FILES; fd++)
+    if (p->pfiles->fd_table[fd]) do_close(fd);
+}
+
+//
+// returns the spike file opened under descriptor fd of current process, or NULL.
+//
+spike_file_t *get_opened_file(int fd) {
+  if (fd < 0 || fd >= MAX_PROC_FILES) return NULL;
+  return current->pfiles->fd_table[fd];
+}
+
+// transfers count bytes between file f (at off, if the operation is positional) and buf.
+typedef ssize_t (*xfer_fn)(spike_file_t *f, void *buf, size_t count, uint64 off);
+
+static ssize_t xfer_read(spike_file_t *f, void *buf, size_t count, uint64 off) {
+  return spike_file_read(f, buf, count);
+}
+
+static ssize_t xfer_write(spike_file_t *f, void *buf, size_t count, uint64 off) {
+  return spike_file_write(f, buf, count);
+}
+
+static ssize_t xfer_pread(spike_file_t *f, void *buf, size_t count, uint64 off) {
+  return spike_file_pread(f, buf, count, off);
+}
+
+static ssize_t xfer_console(spike_file_t *f, void *buf, size_t count, uint64 off) {
+  return htif_console_read(buf, count);
+}
+
+//
+// run op on the user buffer [buf, buf + count) of current process. op gets the buffer by
+// its physical address, so that the host moves the data to/from the user pages directly,
+// without any copy in the kernel. pages are not contiguous in physical memory in general,
+// but the ones allocated one after another usually are: op is called once for each
+// physically contiguous run of pages, which stay pinned while op uses them. to_user tells
+// whether op writes the buffer. stops at the first short transfer, and returns the number
+// of bytes transferred.
+//
+static ssize_t user_xfer(spike_file_t *f, char *buf, uint64 count, uint64 off, int to_user,
+                         xfer_fn op) {
+  ssize_t done = 0;
+  while (done < count) {
+    uint64 va = (uint64)buf + done;
+    // user_va_to_pa_fault() is defined in kernel/mmap.c
+    char *pa = user_va_to_pa_fault(current, va, to_user);
+    if (!pa) return done ? done : -1;
+    pin_page((void *)ROUNDDOWN((uint64)pa, PGSIZE));
+
+    // extend the run over the following pages, as long as they are contiguous.
+    uint64 n = MIN(count - done, PGSIZE - (va & (PGSIZE - 1)));
+    while (done + n < count) {
+      char *next = user_va_to_pa_fault(current, va + n, to_user);
+      if (next != pa + n) break;
+      pin_page(next);
+      n += MIN(count - done - n, PGSIZE);
+    }
+
+    ssize_t r = op(f, pa, n, off + done);
+    for (uint64 page = ROUNDDOWN((uint64)pa, PGSIZE); page < (uint64)pa + n; page += PGSIZE)
+      unpin_page((void *)page);
+
+    if (r < 0) return done ? done : r;
+    done += r;
+    if (r < n) break;
+  }
+  return done;
+}
+
+//
+// write the string [buf, buf + count) of the app to the console (i.e., the stderr of the
+// host, as sprint() does), straight from the user pages.
+//
+ssize_t do_print(char *buf, uint64 count) {
+  return user_xfer(stderr, buf, count, 0, 0, xfer_write);
+}
+
+//
+// give current process a console output ring, mapped at USER_PRINT_RING. returns its
+// address, or -1 if it can not be allocated.
+//
+ssize_t do_print_ring(void) {
+  if (current->pring) return USER_PRINT_RING;
+
+  print_ring *ring = (print_ring *)alloc_page();
+  if (!ring) return -1;
+  memset(ring, 0, PGSIZE);
+  user_vm_map(current->pagetable, USER_PRINT_RING, PGSIZE, (uint64)ring,
+              prot_to_type(PROT_READ | PROT_WRITE, 1));
+  current->pring = ring;
+  return USER_PRINT_RING;
+}
+
+//
+// write what the app of process p has put into its console output ring to the console,
+// in order. called on every trap of the app (i.e., before anything else the app asked for
+// can be printed), so that the output of the ring and of syscalls is not reordered.
+//
+void drain_print_ring(process *p) {
+  print_ring *ring = p->pring;
+  if (!ring) return;
+
+  uint32 head = ring->head, tail = ring->tail;
+  // the app broke the ring, drop what is in there.
+  if (tail - head > PRINT_RING_SIZE) {
+    ring->head = tail;
+    return;
+  }
+
+  while (head != tail) {
+    uint32 pos = head % PRINT_RING_SIZE;
+    uint32 n = MIN(tail - head, PRINT_RING_SIZE - pos);
+    spike_file_write(stderr, ring->data + pos, n);
+    head += n;
+  }
+  ring->head = head;
+}
+
+//
+// whether some process that may run has a console output ring. it can fill the ring without
+// trapping, so the timer interrupts it periodically, and the ring is drained on that trap.
+//
+int print_rings_in_use(void) {
+  for (int i = 0; i < NPROC; i++)
+    if ((procs[i].status == READY || procs[i].status == RUNNING) && procs[i].pring) return 1;
+  return 0;
+}
+
+//
+// gather the console input sent by the host into the ring buffer of the HTIF layer, and wake
+// up the readers if there is any input. called on every timer interrupt.
+//
+void poll_console(void) {
+  htif_console_poll();
+  if (console_readers.head && htif_console_avail() > 0) wakeup(&console_readers);
+}
+
+//
+// whether processes wait for console input, which is then polled periodically.
+//
+int console_has_readers(void) {
+  return console_readers.head != NULL;
+}
+
+//
+// read from the console. takes what has arrived in the ring buffer. if it is empty, the
+// calling process sleeps until some input arrives (and then issues the read again).
+//
+static ssize_t console_read(char *buf, uint64 count) {
+  if (count == 0) return 0;
+  htif_console_poll();
+  if (htif_console_avail() == 0) sleep_on(&console_readers);
+
+  return user_xfer(stdin, buf, count, 0, 1, xfer_console);
+}
+
+//
+// open a host file, and bind it to a free descriptor of current process.
+//
+int do_open(char *pathname, int flags, int mode) {
+  proc_file_management *pfiles = current->pfiles;
+  if (pfiles->nfree == 0) return -1;
+
+  char path[MAX_PATH_LEN];
+  if (strncpy_from_user(current, path, (uint64)pathname, sizeof(path)) < 0) return -1;
+
+  spike_file_t *f = spike_file_open(path, flags, mode);
+  if (IS_ERR_VALUE(f)) return PTR_ERR(f);
+  // a descriptor holds one reference to its file (and so does each copy made by fork), the
+  // one of the opener is not needed.
+  spike_file_decref(f);
+
+  int fd = pfiles->free_fds[--pfiles->nfree];
+  pfiles->fd_table[fd] = f;
+  return fd;
+}
+
+//
+// create a pipe, and store the descriptors of its read and write ends at fds[0] and fds[1]
+// (a user address).
+//
+int do_pipe(int *fds) {
+  proc_file_management *pfiles = current->pfiles;
+  if (pfiles->nfree < 2) return -1;
+
+  spike_file_t *rfile, *wfile;
+  if (pipe_create(&rfile, &wfile) != 0) return -1;
+
+  int kfds[2];
+  kfds[0] = pfiles->free_fds[--pfiles->nfree];
+  pfiles->fd_table[kfds[0]] = rfile;
+  kfds[1] = pfiles->free_fds[--pfiles->nfree];
+  pfiles->fd_table[kfds[1]] = wfile;
+
+  if (copy_to_user(current, (uint64)fds, kfds, sizeof(kfds)) != 0) {
+    do_close(kfds[0]);
+    do_close(kfds[1]);
+    return -1;
+  }
+  return 0;
+}
+
+//
+// write count bytes of buf into the pipe opened under fd, moving its whole pages rather
+// than copying them (see kernel/pipe.c). the pages of buf read as zeros afterwards.
+//
+ssize_t do_vmsplice(int fd, char *buf, uint64 count) {
+  spike_file_t *f = get_opened_file(fd);
+  if (!f || !(f->flags & SPIKE_FILE_PIPE)) return -1;
+  return pipe_write(f, buf, count, 1);
+}
+
+ssize_t do_read(int fd, char *buf, uint64 count) {
+  spike_file_t *f = get_opened_file(fd);
+  if (!f) return -1;
+  // the console is read through the HTIF console device, rather than the host's stdin.
+  if (f == stdin) return console_read(buf, count);
+  if (f->flags & SPIKE_FILE_PIPE) return pipe_read(f, buf, count);
+  return user_xfer(f, buf, count, 0, 1, xfer_read);
+}
+
+ssize_t do_write(int fd, char *buf, uint64 count) {
+  spike_file_t *f = get_opened_file(fd);
+  if (!f) return -1;
+  if (f->flags & SPIKE_FILE_PIPE) return pipe_write(f, buf, count, 0);
+  return user_xfer(f, buf, count, 0, 0, xfer_write);
+}
+
+ssize_t do_pread(int fd, char *buf, uint64 count, uint64 offset) {
+  spike_file_t *f = get_opened_file(fd);
+  if (!f) return -1;
+  return user_xfer(f, buf, count, offset, 1, xfer_pread);
+}
+
+ssize_t do_lseek(int fd, int64 offset, int whence) {
+  spike_file_t *f = get_opened_file(fd);
+  if (!f) return -1;
+  return spike_file_lseek(f, offset, whence);
+}
+
+int do_fstat(int fd, struct stat *st) {
+  spike_file_t *f = get_opened_file(fd);
+  if (!f) return -1;
+
+  struct stat kst;
+  int ret = spike_file_stat(f, &kst);
+  if (ret != 0) return ret;
+  return copy_to_user(current, (uint64)st, &kst, sizeof(kst));
+}
+
+//
+// release descriptor fd, and its reference to the file. the host file is closed with the
+// last reference, unless it is one of the console files, which are shared with the kernel.
+//
+int do_close(int fd) {
+  proc_file_management *pfiles = current->pfiles;
+  spike_file_t *f = get_opened_file(fd);
+  if (!f) return -1;
+
+  pfiles->fd_table[fd] = NULL;
+  pfiles->free_fds[pfiles->nfree++] = fd;
+
+  if (is_console(f)) return 0;
+  if (f->flags & SPIKE_FILE_PIPE) pipe_close(f);
+  spike_file_flush(f);
+  spike_file_decref(f);
+  return 0;
+}
+
+//
+// push the buffered writes of descriptor fd to the host.
+//
+int do_fsync(int fd) {
+  spike_file_t *f = get_opened_file(fd);
+  if (!f) return -1;
+  return spike_file_flush(f);
+}
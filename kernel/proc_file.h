@@ -0,0 +1,47 @@
+#ifndef _PROC_FILE_H_
+#define _PROC_FILE_H_
+
+#include <sys/stat.h>
+
+#include "util/types.h"
+#include "spike_interface/spike_file.h"
+
+// maximum number of files that can be opened by a process at the same time
+#define MAX_PROC_FILES 4096
+// maximum length of a path passed to do_open(), including the terminating NUL
+#define MAX_PATH_LEN 256
+
+// the descriptor table of a process. fd_table[fd] points to the (spike) file opened under
+// descriptor fd, and free_fds is a stack of unused descriptors, so that both allocating and
+// releasing a descriptor take O(1) time.
+typedef struct proc_file_management_t {
+  spike_file_t *fd_table[MAX_PROC_FILES];
+  uint16 free_fds[MAX_PROC_FILES];
+  int nfree;
+} proc_file_management;
+
+struct process_t;
+
+proc_file_management *init_proc_file_management(struct process_t *p);
+void fork_proc_files(struct process_t *parent, struct process_t *child);
+void close_proc_files(struct process_t *p);
+spike_file_t *get_opened_file(int fd);
+
+int do_open(char *pathname, int flags, int mode);
+ssize_t do_read(int fd, char *buf, uint64 count);
+ssize_t do_write(int fd, char *buf, uint64 count);
+ssize_t do_pread(int fd, char *buf, uint64 count, uint64 offset);
+ssize_t do_lseek(int fd, int64 offset, int whence);
+int do_fstat(int fd, struct stat *st);
+int do_close(int fd);
+int do_fsync(int fd);
+int do_pipe(int *fds);
+ssize_t do_vmsplice(int fd, char *buf, uint64 count);
+ssize_t do_print(char *buf, uint64 count);
+void poll_console(void);
+int console_has_readers(void);
+ssize_t do_print_ring(void);
+void drain_print_ring(struct process_t *p);
+int print_rings_in_use(void);
+
+#endif
@@ -1,9 +1,10 @@
 /*
- * Utility functions for process management. 
+ * Utility functions for process management.
  *
- * Note: in Lab1, only one process (i.e., our user application) exists. Therefore, 
- * PKE OS at this stage will set "current" to the loaded user application, and also
- * switch to the old "current" process after trap handling.
+ * processes live in a fixed pool. the application loaded at boot is the first process,
+ * and the others are forked from it: a child starts with a copy of the memory of its
+ * parent, and the descriptors of its parent (i.e., it shares the opened files and pipes).
+ * an exited process stays a ZOMBIE until its parent collects its exit code by do_wait().
  */
 
 #include "riscv.h"
@@ -12,32 +13,51 @@
 #include "process.h"
 #include "elf.h"
 #include "string.h"
+#include "boottime.h"
+#include "trace.h"
+#include "pmm.h"
+#include "vmm.h"
+#include "sched.h"
+#include "profile.h"
 
 #include "spike_interface/spike_utils.h"
 
 //Two functions defined in kernel/usertrap.S
-extern char smode_trap_vector[];
-extern void return_to_user(trapframe*);
+extern char smode_trap_vectors[];
+extern void return_to_user(trapframe*, uint64 satp);
+
+// trap_sec_start points to the beginning of S-mode trap segment (i.e., the entry point of
+// S-mode trap vector).
+extern char trap_sec_start[];
 
 // current points to the currently running user-mode application.
 process* current = NULL;
 
+process procs[NPROC];
+
+uint64 user_stack_max = USER_STACK_MAX;
+
+// processes waiting in do_wait() for a child to exit
+static wait_queue exit_waiters;
+
 //
 // switch to a user-mode process
 //
 void switch_to(process* proc) {
+  boot_phase(BOOT_RETURN_TO_USER);
   assert(proc);
   current = proc;
 
-  // write the smode_trap_vector (64-bit func. address) defined in kernel/strap_vector.S
-  // to the stvec privilege register, such that trap handler pointed by smode_trap_vector
-  // will be triggered when an interrupt occurs in S mode.
-  write_csr(stvec, (uint64)smode_trap_vector);
+  // write the vector table smode_trap_vectors defined in kernel/strap_vector.S to the
+  // stvec privilege register in Vectored mode, such that each kind of trap enters at its
+  // own entry point in S mode.
+  write_csr(stvec, (uint64)smode_trap_vectors | STVEC_VECTORED);
 
   // set up trapframe values (in process structure) that smode_trap_vector will need when
   // the process next re-enters the kernel.
   proc->trapframe->kernel_sp = proc->kstack;  // process's kernel stack
   proc->trapframe->kernel_trap = (uint64)smode_trap_handler;
+  proc->trapframe->kernel_satp = read_csr(satp);  // kernel page table
 
   // SSTATUS_SPP and SSTATUS_SPIE are defined in kernel/riscv.h
   // set S Previous Privilege mode (the SSTATUS_SPP bit in sstatus register) to User mode.
@@ -51,6 +71,223 @@ void switch_to(process* proc) {
   // set S Exception Program Counter (sepc register) to the elf entry pc.
   write_csr(sepc, proc->trapframe->epc);
 
+  // make user page table. macro MAKE_SATP is defined in kernel/riscv.h
+  uint64 user_satp = MAKE_SATP(proc->pagetable);
+  proc->trapframe->user_satp = user_satp;
+
+  // the first entry to user mode ends booting, print how long each boot phase took.
+  // boot_report() is defined in kernel/boottime.c, and does nothing afterwards.
+  boot_report();
+
+  TRACE(TRACE_TRAP_END, proc->pid, 0);
+
+  // charge the hardware counters to the process from here on. defined in kernel/perf.c
+  perf_switch_in(&proc->perf);
+
   // return_to_user() is defined in kernel/strap_vector.S. switch to user mode with sret.
-  return_to_user(proc->trapframe);
+  // note, return_to_user takes two parameters.
+  return_to_user(proc->trapframe, user_satp);
+}
+
+//
+// give back the trapframe and the kernel stack of process p, whose user memory is already
+// released, and return its slot to the pool.
+//
+static void release_process(process* p) {
+  free_page(p->trapframe);
+  free_page((void*)(p->kstack - PGSIZE));
+  p->parent = NULL;
+  p->status = FREE;
+}
+
+//
+// take a FREE slot of the pool, and give the process there its trapframe, its kernel
+// stack, its page table (with the trapframe and the trap vectors mapped), its descriptor
+// table and no mmap() areas. returns NULL if the pool or the memory is used up.
+//
+process* alloc_process(void) {
+  process* p = NULL;
+  for (int i = 0; i < NPROC && !p; i++) {
+    // nobody waits for an exited process whose parent has gone, reclaim it here.
+    if (procs[i].status == ZOMBIE && !procs[i].parent) release_process(&procs[i]);
+    if (procs[i].status == FREE) p = &procs[i];
+  }
+  if (!p) return NULL;
+
+  // alloc_page is defined in kernel/pmm.c.
+  void *tf = alloc_page(), *kstack = alloc_page(), *pagetable = alloc_page();
+  if (!tf || !kstack || !pagetable) {
+    if (tf) free_page(tf);
+    if (kstack) free_page(kstack);
+    if (pagetable) free_page(pagetable);
+    return NULL;
+  }
+
+  memset(p, 0, sizeof(process));
+  p->pid = p - procs;
+  p->trapframe = (trapframe*)tf;
+  memset(p->trapframe, 0, sizeof(trapframe));
+  p->kstack = (uint64)kstack + PGSIZE;  // user kernel stack top
+  p->pagetable = (pagetable_t)pagetable;
+  memset((void*)p->pagetable, 0, PGSIZE);
+
+  // map trapframe in user space (direct mapping as in kernel space).
+  user_vm_map(p->pagetable, (uint64)p->trapframe, PGSIZE, (uint64)p->trapframe,
+              prot_to_type(PROT_WRITE | PROT_READ, 0));
+
+  // map S-mode trap vector section in user space (direct mapping as in kernel space)
+  // here, we assume that the size of usertrap.S is smaller than a page.
+  user_vm_map(p->pagetable, (uint64)trap_sec_start, PGSIZE, (uint64)trap_sec_start,
+              prot_to_type(PROT_READ | PROT_EXEC, 0));
+
+  // init_proc_file_management() is defined in kernel/proc_file.c
+  p->pfiles = init_proc_file_management(p);
+  // init_mmap_management() is defined in kernel/mmap.c
+  init_mmap_management(&p->mmaps);
+  // the heap is placed by the elf loader (or inherited by fork).
+  p->heap_start = p->heap_end = 0;
+  p->stack_limit = USER_STACK_TOP - user_stack_max;
+
+  p->status = BLOCKED;  // not FREE any more, and not ready to run yet
+  return p;
+}
+
+// the state of copying the user memory of a parent into its child
+typedef struct fork_copy_t {
+  process *parent, *child;
+  int failed;
+} fork_copy;
+
+// user_vm_walk() callback of do_fork(): copy the page at va of the parent into the child.
+static void fork_copy_page(uint64 va, pte_t* pte, void* arg) {
+  fork_copy* fc = (fork_copy*)arg;
+  // the pages of shared mappings are shared with the child as well, see fork_mmap().
+  // so are the pages of shared memory segments, see fork_shm().
+  if (fc->failed || mmap_is_shared(fc->parent, va) || (*pte & PTE_SHARED)) return;
+
+  void* pa = alloc_page();
+  if (!pa) {
+    fc->failed = 1;
+    return;
+  }
+  memcpy(pa, (void*)PTE2PA(*pte), PGSIZE);
+  user_vm_map(fc->child->pagetable, va, PGSIZE, (uint64)pa, PTE_FLAGS(*pte) & ~PTE_V);
+  if (va == USER_PRINT_RING) fc->child->pring = (print_ring*)pa;
+}
+
+// user_vm_walk() callback of do_exit(): free the page mapped at va.
+static void exit_free_page(uint64 va, pte_t* pte, void* arg) {
+  free_page((void*)PTE2PA(*pte));
+  *pte = 0;
+}
+
+//
+// release the user memory of process p: its mappings, its pages and its page table.
+//
+static void free_user_memory(process* p) {
+  // exit_mmap() is defined in kernel/mmap.c, exit_shm() in kernel/shm.c
+  exit_mmap(p);
+  exit_shm(p);
+  user_vm_walk(p->pagetable, exit_free_page, NULL);
+  free_pagetable(p->pagetable);
+  p->pagetable = NULL;
+  p->pring = NULL;
+}
+
+//
+// create a child of current process, which resumes from the same syscall with a copy of
+// its memory and its descriptors. returns the pid of the child (the child gets 0), or -1.
+//
+int do_fork(void) {
+  process* parent = current;
+  process* child = alloc_process();
+  if (!child) return -1;
+
+  fork_copy fc = {parent, child, 0};
+  user_vm_walk(parent->pagetable, fork_copy_page, &fc);
+  if (fc.failed) {
+    free_user_memory(child);
+    release_process(child);
+    return -1;
+  }
+  // fork_mmap() is defined in kernel/mmap.c, fork_shm() in kernel/shm.c, and
+  // fork_proc_files() in kernel/proc_file.c
+  fork_mmap(parent, child);
+  fork_shm(parent, child);
+  fork_proc_files(parent, child);
+
+  // the registers (including epc, past the ecall) are the ones of the parent, except a0.
+  memcpy(child->trapframe, parent->trapframe, sizeof(trapframe));
+  child->trapframe->regs.a0 = 0;
+  child->heap_start = parent->heap_start;
+  child->heap_end = parent->heap_end;
+  child->stack_limit = parent->stack_limit;
+  child->parent = parent;
+  // the child runs the image of the parent, at the same place.
+  profile_set_bias(child->pid, profile_bias(parent->pid));
+
+  insert_to_ready_queue(child);
+  return child->pid;
+}
+
+//
+// terminate current process with code. the process stays a ZOMBIE, holding only its
+// slot, its trapframe and its kernel stack (which is in use until schedule() leaves it),
+// until its parent collects it. the last process shuts the system down. never returns.
+//
+void do_exit(int code) {
+  process* p = current;
+
+  int others = 0;
+  for (int i = 0; i < NPROC; i++)
+    if (&procs[i] != p && procs[i].status != FREE && procs[i].status != ZOMBIE) others++;
+  if (others == 0) {
+    // write the samples of the profiler and the records of the tracer (if on) to the host.
+    profile_dump();
+    trace_dump();
+    shutdown(code);
+  }
+
+  // close_proc_files() is defined in kernel/proc_file.c
+  close_proc_files(p);
+  free_user_memory(p);
+
+  // the children of p are not waited for any more.
+  for (int i = 0; i < NPROC; i++) {
+    if (procs[i].parent != p) continue;
+    procs[i].parent = NULL;
+    if (procs[i].status == ZOMBIE) release_process(&procs[i]);
+  }
+
+  p->exit_code = code;
+  p->status = ZOMBIE;
+  wakeup(&exit_waiters);
+  schedule();
+}
+
+//
+// wait for the child pid (any child if pid is -1) of current process to exit, and release
+// it. stores its exit code at code (a user address), unless code is 0. returns the pid of
+// the child, or -1 if there is no such child.
+//
+int do_wait(int pid, uint64 code) {
+  int found = 0;
+  for (int i = 0; i < NPROC; i++) {
+    process* child = &procs[i];
+    if (child->parent != current || (pid >= 0 && child->pid != pid)) continue;
+    found = 1;
+    if (child->status != ZOMBIE) continue;
+
+    // the child is only released once its exit code is delivered, so that a bad code
+    // pointer does not lose it: the parent may wait for it again.
+    int exit_code = child->exit_code;
+    if (code && copy_to_user(current, code, &exit_code, sizeof(exit_code)) != 0) return -1;
+    release_process(child);
+    return i;
+  }
+  if (!found) return -1;
+
+  // sleep_on() is defined in kernel/sched.c, and never returns.
+  sleep_on(&exit_waiters);
+  return -1;
 }
@@ -2,6 +2,13 @@
 #define _PROC_H_
 
 #include "riscv.h"
+#include "config.h"
+#include "proc_file.h"
+#include "mmap.h"
+#include "shm.h"
+#include "perf.h"
+#include "timer.h"
+#include "util/print_ring.h"
 
 typedef struct trapframe_t {
   // space to store context (all common registers)
@@ -13,18 +20,75 @@ typedef struct trapframe_t {
   /* offset:256 */ uint64 kernel_trap;
   // saved user process counter
   /* offset:264 */ uint64 epc;
+
+  // kernel page table
+  /* offset:272 */ uint64 kernel_satp;
+  // user page table, restored by the fast trap paths
+  /* offset:280 */ uint64 user_satp;
 }trapframe;
 
+// possible status of a process
+typedef enum proc_status_t {
+  FREE,            // unused state
+  READY,           // ready state
+  RUNNING,         // currently running
+  BLOCKED,         // waiting for something
+  ZOMBIE,          // terminated but not reclaimed yet
+}proc_status;
+
 // the extremely simple definition of process, used for begining labs of PKE
 typedef struct process_t {
   // pointing to the stack used in trap handling.
   uint64 kstack;
+  // user page table
+  pagetable_t pagetable;
   // trapframe storing the context of a (User mode) process.
   trapframe* trapframe;
+  // descriptor table of the files opened by the process.
+  proc_file_management* pfiles;
+  // the file mappings made by mmap().
+  mmap_management mmaps;
+  // the shared memory segments attached.
+  shm_management shm;
+  // the heap, [heap_start, heap_end), whose pages are allocated on first touch.
+  uint64 heap_start, heap_end;
+  // the lowest address the stack may grow down to. stack pages (up to USER_STACK_TOP) are
+  // also allocated on first touch.
+  uint64 stack_limit;
+
+  // console output ring shared with the app (NULL until the app enables it).
+  print_ring* pring;
+  // the performance counters virtualized for the process.
+  perf_ctx perf;
+
+  // process id
+  uint64 pid;
+  // process status
+  int status;
+  // next queue element (in the ready queue, or a wait queue)
+  struct process_t *queue_next;
+  // what the process waits for on a shared wait queue (e.g., the address of a futex)
+  uint64 wait_key;
+  // the timer that ends a sleep (see do_nanosleep()), and whether the process sleeps
+  wheel_timer sleep_timer;
+  int sleeping;
+
+  // the process that forked this one, NULL once it has exited
+  struct process_t *parent;
+  // the code passed to exit(), kept for the parent while the process is a ZOMBIE
+  int exit_code;
 }process;
 
 void switch_to(process*);
+process* alloc_process(void);
+int do_fork(void);
+void do_exit(int code);
+int do_wait(int pid, uint64 code);
 
 extern process* current;
+// the process pool, procs[i] has pid i
+extern process procs[NPROC];
+// the maximum size of the user stacks (set by the --stack-max kernel option)
+extern uint64 user_stack_max;
 
 #endif
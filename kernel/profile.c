@@ -0,0 +1,135 @@
+/*
+ * sampling profiler. when it is on (kernel option --profile=<host file>), the M-mode timer
+ * fires every PROFILE_INTERVAL, and each interrupt records the interrupted pc, privilege
+ * mode and current process into the sample buffer of the hart, along with the callers found
+ * by walking the frame pointers (everything is built with -fno-omit-frame-pointer). the
+ * buffers are written to the host file at shutdown, and tools/pke_prof.py turns them into
+ * flat and folded-stack profiles by symbolising the pcs against the kernel and app ELFs.
+ */
+
+#include "profile.h"
+#include "config.h"
+#include "process.h"
+#include "vmm.h"
+#include "string.h"
+
+#include "spike_interface/spike_utils.h"
+
+volatile int g_profiling = 0;
+
+static prof_sample samples[NCPU][PROF_MAX_SAMPLES];
+static uint64 nsamples[NCPU], ndropped[NCPU];
+static char prof_path[128];
+// the load bias of the app of each pid. a pid is the slot of its process, so this is the
+// bias of the last app that ran under the pid.
+static uint64 load_bias[NPROC];
+
+//
+// turn on profiling, the samples go to the host file path at shutdown.
+//
+int profile_start(const char *path) {
+  if (strlen(path) >= sizeof(prof_path)) return -1;
+  strcpy(prof_path, path);
+  g_profiling = 1;
+  return 0;
+}
+
+//
+// read the uint64 at address va of the interrupted context (of privilege mode) into *val.
+// M mode runs untranslated: a user address goes through the page table of the current
+// process, a kernel address is its physical address. returns -1 if va is not mapped.
+//
+static int peek(uint32 mode, uint64 va, uint64 *val) {
+  if (va & 7) return -1;
+  uint64 pa = va;
+  if (mode == 0) {
+    if (!current) return -1;
+    pa = (uint64)user_va_to_pa(current->pagetable, (void *)va);
+    if (!pa) return -1;
+  } else if (va < DRAM_BASE || va + 8 > PHYS_TOP) {
+    return -1;
+  }
+  *val = *(uint64 *)pa;
+  return 0;
+}
+
+//
+// record the return addresses of the callers into frames, innermost first, by walking the
+// frame pointers from fp: a frame keeps the return address at fp-8 and the frame pointer
+// of the caller at fp-16. the walk stops at PROF_DEPTH frames, or at a frame pointer that
+// is not above the last one (the stacks grow down) or not mapped, e.g., at the trap entry.
+//
+static void walk_frames(uint32 mode, uint64 sp, uint64 fp, uint64 *frames) {
+  memset(frames, 0, PROF_DEPTH * sizeof(uint64));
+  if (mode == 3) return;
+  for (int i = 0; i < PROF_DEPTH && fp > sp; i++) {
+    uint64 ra, prev;
+    if (peek(mode, fp - 8, &ra) != 0 || peek(mode, fp - 16, &prev) != 0 || ra == 0) return;
+    frames[i] = ra;
+    sp = fp;
+    fp = prev;
+  }
+}
+
+//
+// record a sample of the context interrupted at pc, whose stack and frame pointers are sp
+// and fp. called by the M-mode timer handler (kernel/machine/mtrap.c).
+//
+void profile_sample(int hartid, uint64 pc, uint32 mode, uint64 sp, uint64 fp) {
+  if (nsamples[hartid] == PROF_MAX_SAMPLES) {
+    ndropped[hartid]++;
+    return;
+  }
+
+  prof_sample *s = &samples[hartid][nsamples[hartid]++];
+  s->pc = pc;
+  s->pid = current ? current->pid : (uint32)-1;
+  s->mode = mode;
+  walk_frames(mode, sp, fp, s->frames);
+}
+
+//
+// record that the app of process pid is loaded bias bytes away from its link addresses
+// (non-zero for a PIE, see elf_place() in kernel/elf.c), so that its pcs can be symbolised.
+//
+void profile_set_bias(int pid, uint64 bias) {
+  load_bias[pid] = bias;
+}
+
+uint64 profile_bias(int pid) {
+  return load_bias[pid];
+}
+
+//
+// write the samples to the host file, and turn profiling off. called before shutdown.
+//
+void profile_dump(void) {
+  if (!g_profiling) return;
+  g_profiling = 0;
+
+  spike_file_t *f = spike_file_open(prof_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (IS_ERR_VALUE(f)) {
+    sprint("profile: fail on opening %s.\n", prof_path);
+    return;
+  }
+
+  prof_header hdr;
+  memcpy(hdr.magic, PROF_MAGIC, sizeof(hdr.magic));
+  hdr.interval = PROFILE_INTERVAL;
+  hdr.nharts = NCPU;
+  hdr.nprocs = NPROC;
+  hdr.depth = PROF_DEPTH;
+  spike_file_write(f, &hdr, sizeof(hdr));
+  spike_file_write(f, load_bias, sizeof(load_bias));
+
+  uint64 total = 0;
+  for (int i = 0; i < NCPU; i++) {
+    uint64 counts[2] = {nsamples[i], ndropped[i]};
+    spike_file_write(f, counts, sizeof(counts));
+    spike_file_write(f, samples[i], nsamples[i] * sizeof(prof_sample));
+    total += nsamples[i];
+  }
+  spike_file_close(f);
+
+  sprint("profile: %ld samples written to %s.\n", total, prof_path);
+}
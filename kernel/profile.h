@@ -0,0 +1,42 @@
+#ifndef _PROFILE_H_
+#define _PROFILE_H_
+
+#include "util/types.h"
+
+// capacity of the sample buffer of each hart. samples beyond it are counted, but dropped.
+#define PROF_MAX_SAMPLES 32768
+// the callers recorded per sample, at most
+#define PROF_DEPTH 6
+
+// one sample: where the hart was when the timer interrupted it
+typedef struct prof_sample_t {
+  uint64 pc;    // the interrupted pc (a user address if mode is 0)
+  uint32 pid;   // pid of the current process, or -1 if there is none yet
+  uint32 mode;  // privilege mode: 0 user, 1 supervisor, 3 machine
+  // the return addresses into the callers, innermost first, 0 after the last one
+  uint64 frames[PROF_DEPTH];
+} prof_sample;
+
+// layout of the profile file written by profile_dump(): a header, then the load bias of
+// each pid (nprocs uint64, the app of the pid is placed that far from its link addresses),
+// then for each hart the number of samples kept and dropped (two uint64), followed by its
+// samples.
+#define PROF_MAGIC "PKEPROF3"
+typedef struct prof_header_t {
+  char magic[8];
+  uint64 interval;  // PROFILE_INTERVAL, in mtime units
+  uint64 nharts;
+  uint64 nprocs;
+  uint64 depth;     // PROF_DEPTH
+} prof_header;
+
+// set when profiling is on, read by the M-mode timer handler
+extern volatile int g_profiling;
+
+int profile_start(const char *path);
+void profile_sample(int hartid, uint64 pc, uint32 mode, uint64 sp, uint64 fp);
+void profile_set_bias(int pid, uint64 bias);
+uint64 profile_bias(int pid);
+void profile_dump(void);
+
+#endif
@@ -52,6 +52,14 @@
 #define CAUSE_LOAD_PAGE_FAULT 0xd      // Load page fault
 #define CAUSE_STORE_PAGE_FAULT 0xf     // Store/AMO page fault
 
+// interrupts (mcause/scause with the highest bit set)
+#define CAUSE_MTIMER 0x8000000000000007        // M-mode timer interrupt
+#define CAUSE_MTIMER_S_TRAP 0x8000000000000001 // S-mode software interrupt, raised by the
+                                               // M-mode timer handler
+
+// mode of stvec: interrupts enter at BASE + 4 * cause, exceptions at BASE
+#define STVEC_VECTORED 1L
+
 // fields of sstatus, the Supervisor mode Status register
 #define SSTATUS_SPP (1L << 8)   // Previous mode, 1=Supervisor, 0=User
 #define SSTATUS_SPIE (1L << 5)  // Supervisor Previous Interrupt Enable
@@ -71,6 +79,24 @@
 #define MIE_MTIE (1L << 7)   // timer
 #define MIE_MSIE (1L << 3)   // software
 
+// fields of sip, the Supervisor Interrupt Pending register
+#define SIP_SSIP (1L << 1)  // software
+
+// core local interruptor (CLINT), which contains the timer.
+#define CLINT 0x2000000L
+#define CLINT_MTIMECMP(hartid) (CLINT + 0x4000 + 8 * (hartid))
+#define CLINT_MTIME (CLINT + 0xBFF8)  // cycles since boot.
+
+// the call that S mode makes to M mode (with ecall, as in the SBI) to be interrupted at the
+// time in a0 (in mtime units, -1 for never). the number goes to a7.
+#define SBI_SET_TIMER 0
+
+// fields of mcounteren and scounteren, making counters readable in the next lower mode
+#define COUNTEREN_CY (1 << 0)  // cycle
+#define COUNTEREN_TM (1 << 1)  // time
+#define COUNTEREN_IR (1 << 2)  // instret
+#define COUNTEREN_HPM(n) (1 << (n))  // hpmcounter<n>, n in 3..31
+
 #define read_const_csr(reg)              \
   ({                                     \
     unsigned long __tmp;                 \
@@ -135,6 +161,52 @@ static inline uint64 read_tp(void) {
 // write tp, the thread pointer, holding hartid (core number), the index into cpus[].
 static inline void write_tp(uint64 x) { asm volatile("mv tp, %0" : : "r"(x)); }
 
+// use riscv's sv39 page table scheme.
+#define SATP_SV39 (8L << 60)
+#define MAKE_SATP(pagetable) (SATP_SV39 | (((uint64)pagetable) >> 12))
+
+#define PGSIZE 4096  // bytes per page
+#define PGSHIFT 12   // offset bits within a page
+
+// fields of a page table entry
+#define PTE_V (1L << 0)  // valid
+#define PTE_R (1L << 1)  // readable
+#define PTE_W (1L << 2)  // writable
+#define PTE_X (1L << 3)  // executable
+#define PTE_U (1L << 4)  // 1 -> user can access
+#define PTE_G (1L << 5)  // global
+#define PTE_A (1L << 6)  // accessed
+#define PTE_D (1L << 7)  // dirty
+// software bit: the page is shared with other address spaces (e.g., a shared memory
+// segment), rather than owned by the process alone
+#define PTE_SHARED (1L << 8)
+
+// shift a physical address to the right place for a PTE.
+#define PA2PTE(pa) ((((uint64)pa) >> 12) << 10)
+// convert a PTE to the physical address it points to.
+#define PTE2PA(pte) (((pte) >> 10) << 12)
+// extract the property bits of a pte
+#define PTE_FLAGS(pte) ((pte)&0x3FF)
+
+// extract the three 9-bit page table indices from a virtual address.
+#define PXMASK 0x1FF  // 9 bits
+#define PXSHIFT(level) (PGSHIFT + (9 * (level)))
+#define PX(level, va) ((((uint64)(va)) >> PXSHIFT(level)) & PXMASK)
+
+// one beyond the highest possible virtual address.
+// MAXVA is actually one bit less than the max allowed by Sv39, to avoid having to
+// sign-extend virtual addresses that have the high bit set.
+#define MAXVA (1L << (9 + 9 + 9 + 12 - 1))
+
+// bytes mapped by a leaf at level 1 of the page table (a "megapage" of Sv39).
+#define SUPERPAGE_SIZE (1L << PXSHIFT(1))
+
+typedef uint64 pte_t;
+typedef uint64 *pagetable_t;  // 512 PTEs
+
+// flush the TLB.
+static inline void flush_tlb(void) { asm volatile("sfence.vma zero, zero"); }
+
 typedef struct riscv_regs_t {
   /*  0  */ uint64 ra;
   /*  8  */ uint64 sp;
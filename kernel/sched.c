@@ -0,0 +1,131 @@
+/*
+ * implementing the scheduling related functions.
+ *
+ * the ready queue holds the processes waiting for the hart, in FIFO order. a process that
+ * has to wait for an event (e.g., console input) sleeps on a wait queue, and the hart
+ * is stopped (by wfi) while nothing is ready to run, rather than spinning.
+ */
+
+#include "sched.h"
+#include "strap.h"
+#include "timer.h"
+#include "pmm.h"
+#include "profile.h"
+#include "trace.h"
+#include "spike_interface/spike_utils.h"
+
+static process* ready_queue_head = NULL;
+static process* ready_queue_tail = NULL;
+// number of processes sleeping on wait queues
+static int nr_blocked = 0;
+
+static void queue_append(process** head, process** tail, process* proc) {
+  proc->queue_next = NULL;
+  if (*head == NULL) *head = proc;
+  else (*tail)->queue_next = proc;
+  *tail = proc;
+}
+
+//
+// insert a process, proc, into the END of ready queue.
+//
+void insert_to_ready_queue(process* proc) {
+  // proc is already in the queue
+  if (proc->status == READY) return;
+
+  proc->status = READY;
+  queue_append(&ready_queue_head, &ready_queue_tail, proc);
+}
+
+//
+// wait (with the hart stopped) for the next timer interrupt, and handle it. S-mode
+// interrupts are disabled in the kernel (sstatus.SIE is 0), so the interrupt is not taken
+// as a trap: wfi returns once it is pending, and it is found in sip.
+//
+static void idle(void) {
+  // make use of the idle time: zero pages ahead for the page faults to come.
+  // refill_zeroed_pages() is defined in kernel/pmm.c
+  refill_zeroed_pages();
+  asm volatile("wfi");
+  if (read_csr(sip) & SIP_SSIP) handle_mtimer_trap();
+}
+
+//
+// choose a proc from the ready queue, and put it to run. never returns.
+//
+void schedule() {
+  // the process about to run, or the idle hart, is interrupted at the next deadline only.
+  // timer_reprogram() is defined in kernel/timer.c
+  timer_reprogram();
+
+  while (!ready_queue_head) {
+    // nothing is ready, and nothing will be: all processes are FREE or ZOMBIE.
+    if (nr_blocked == 0) {
+      sprint("no more ready processes, system shutdown now.\n");
+      profile_dump();
+      trace_dump();
+      shutdown(0);
+    }
+    idle();
+  }
+
+  current = ready_queue_head;
+  assert(current->status == READY);
+  ready_queue_head = ready_queue_head->queue_next;
+
+  current->status = RUNNING;
+  switch_to(current);
+}
+
+//
+// block current process on q, and run another process. current must be in a syscall: it
+// re-issues the syscall when it is woken up, and so checks again whether it can proceed.
+// never returns.
+//
+void sleep_on(wait_queue* q) {
+  // handle_syscall() has moved epc past the ecall instruction, move it back.
+  current->trapframe->epc -= 4;
+  current->status = BLOCKED;
+  queue_append(&q->head, &q->tail, current);
+  nr_blocked++;
+
+  schedule();
+}
+
+//
+// make all processes sleeping on q ready to run.
+//
+void wakeup(wait_queue* q) {
+  while (q->head) {
+    process* proc = q->head;
+    q->head = proc->queue_next;
+    nr_blocked--;
+    insert_to_ready_queue(proc);
+  }
+  q->tail = NULL;
+}
+
+//
+// make up to n processes sleeping on q for key (their wait_key) ready to run, in FIFO
+// order. returns the number of processes woken up.
+//
+int wakeup_key(wait_queue* q, uint64 key, int n) {
+  int woken = 0;
+  process *prev = NULL, *proc = q->head;
+  while (proc && woken < n) {
+    process* next = proc->queue_next;
+    if (proc->wait_key == key) {
+      // unlink proc from q
+      if (prev) prev->queue_next = next;
+      else q->head = next;
+      if (q->tail == proc) q->tail = prev;
+      nr_blocked--;
+      insert_to_ready_queue(proc);
+      woken++;
+    } else {
+      prev = proc;
+    }
+    proc = next;
+  }
+  return woken;
+}
@@ -0,0 +1,17 @@
+#ifndef _SCHED_H_
+#define _SCHED_H_
+
+#include "process.h"
+
+// a queue of processes blocked on the same event
+typedef struct wait_queue_t {
+  process *head, *tail;
+} wait_queue;
+
+void insert_to_ready_queue(process* proc);
+void schedule();
+void sleep_on(wait_queue* q);
+void wakeup(wait_queue* q);
+int wakeup_key(wait_queue* q, uint64 key, int n);
+
+#endif
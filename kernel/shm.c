@@ -0,0 +1,210 @@
+/*
+ * shared memory segments.
+ *
+ * a segment is a named set of physical pages, which every process attaching it maps into
+ * its address space, so that the processes exchange data without any copy or trap. the
+ * pages are allocated (and zeroed) when the segment is created. its name holds a reference
+ * to it, dropped when the name is unlinked (shm_unlink) or when the creator exits; the
+ * segment can not be attached anew after that, and its pages are freed once the last
+ * attachment goes away (detached, or ended by exit) too. a forked child inherits the
+ * segments attached by its parent.
+ *
+ * the id of a segment carries a generation number besides its slot, so that the id of a
+ * segment gone does not name the next segment created in the slot.
+ *
+ * with SHM_HUGE, a segment is backed by physically contiguous superpages, each mapped by
+ * one leaf of the page table, which spares the TLB entries and page table pages of 512
+ * ordinary pages.
+ */
+
+#include "shm.h"
+#include "process.h"
+#include "vmm.h"
+#include "pmm.h"
+#include "string.h"
+#include "util/functions.h"
+#include "spike_interface/spike_utils.h"
+
+typedef struct shm_segment_t {
+  char name[SHM_NAME_LEN];
+  uint64 size;    // bytes, a multiple of unit
+  uint64 unit;    // PGSIZE, or SUPERPAGE_SIZE for SHM_HUGE segments
+  uint64 *units;  // physical addresses of the size / unit pages (or superpages)
+  int refcnt;     // number of attachments, in all processes, plus one while linked
+  int linked;     // whether the name still leads to the segment
+  int creator;    // pid of the process that created it
+  uint32 gen;     // generation of the slot, bumped whenever a segment in it is freed
+  int used;
+} shm_segment;
+
+static shm_segment segments[SHM_MAX_SEGMENTS];
+
+// the id of a segment is its slot, plus the generation of the slot above SHM_ID_SHIFT.
+#define SHM_ID_SHIFT 8
+#define shm_id(s) ((int)(((s)->gen << SHM_ID_SHIFT) | ((s) - segments)))
+
+#define nunits(s) ((s)->size / (s)->unit)
+// pages holding the array units of segment s
+#define array_pages(s) (ROUNDUP(nunits(s) * sizeof(uint64), PGSIZE) / PGSIZE)
+
+// release the memory of segment s.
+static void free_segment(shm_segment *s) {
+  for (uint64 i = 0; i < nunits(s) && s->units[i]; i++)
+    for (uint64 off = 0; off < s->unit; off += PGSIZE) free_page((void *)(s->units[i] + off));
+  for (uint64 i = 0; i < array_pages(s); i++) free_page((char *)s->units + i * PGSIZE);
+  s->used = 0;
+  // the generation stays below 2^23, so that ids are non-negative.
+  s->gen = (s->gen + 1) & ((1U << (31 - SHM_ID_SHIFT)) - 1);
+}
+
+// drop a reference to segment s, and free it with the last one.
+static void put_segment(shm_segment *s) {
+  if (--s->refcnt == 0) free_segment(s);
+}
+
+// drop the reference of the name of segment s.
+static void unlink_segment(shm_segment *s) {
+  s->linked = 0;
+  put_segment(s);
+}
+
+//
+// create a segment of size bytes named name (a user address), or find the one of that name
+// (which must hold size bytes at least). returns the id of the segment, or -1.
+//
+int do_shm_create(char *name, uint64 size, int flags) {
+  char kname[SHM_NAME_LEN];
+  if (strncpy_from_user(current, kname, (uint64)name, sizeof(kname)) < 0) return -1;
+
+  shm_segment *s = NULL;
+  for (int i = 0; i < SHM_MAX_SEGMENTS; i++) {
+    if (segments[i].used && segments[i].linked && strcmp(segments[i].name, kname) == 0)
+      return size <= segments[i].size ? shm_id(&segments[i]) : -1;
+    if (!segments[i].used && !s) s = &segments[i];
+  }
+  if (!s || size == 0 || size > SHM_SLOT_SIZE) return -1;
+
+  s->unit = (flags & SHM_HUGE) ? SUPERPAGE_SIZE : PGSIZE;
+  s->size = ROUNDUP(size, s->unit);
+  // alloc_pages() is defined in kernel/pmm.c
+  s->units = alloc_pages(array_pages(s), PGSIZE);
+  if (!s->units) return -1;
+  memset(s->units, 0, array_pages(s) * PGSIZE);
+  s->used = 1;
+
+  for (uint64 i = 0; i < nunits(s); i++) {
+    void *pa = alloc_pages(s->unit / PGSIZE, s->unit);
+    if (!pa) {
+      free_segment(s);
+      return -1;
+    }
+    memset(pa, 0, s->unit);
+    s->units[i] = (uint64)pa;
+  }
+
+  strcpy(s->name, kname);
+  // the reference of the name.
+  s->refcnt = 1;
+  s->linked = 1;
+  s->creator = current->pid;
+  return shm_id(s);
+}
+
+//
+// unlink the segment named name (a user address): the name no longer leads to it, and it
+// is freed once the last process detaches it. returns 0, or -1 if there is no such segment.
+//
+int do_shm_unlink(char *name) {
+  char kname[SHM_NAME_LEN];
+  if (strncpy_from_user(current, kname, (uint64)name, sizeof(kname)) < 0) return -1;
+
+  for (int i = 0; i < SHM_MAX_SEGMENTS; i++) {
+    if (segments[i].used && segments[i].linked && strcmp(segments[i].name, kname) == 0) {
+      unlink_segment(&segments[i]);
+      return 0;
+    }
+  }
+  return -1;
+}
+
+// map segment s at va of page table pt.
+static void map_segment(pagetable_t pt, shm_segment *s, uint64 va) {
+  int perm = prot_to_type(PROT_READ | PROT_WRITE, 1) | PTE_SHARED;
+  for (uint64 i = 0; i < nunits(s); i++) {
+    if (s->unit == PGSIZE) user_vm_map(pt, va + i * PGSIZE, PGSIZE, s->units[i], perm);
+    else user_vm_map_superpage(pt, va + i * s->unit, s->units[i], perm);
+  }
+}
+
+// map segment id into slot of process p (a free one), and take a reference to it.
+static uint64 attach(process *p, int slot, int id) {
+  shm_segment *s = &segments[id];
+  uint64 va = USER_SHM_START + (uint64)slot * SHM_SLOT_SIZE;
+  map_segment(p->pagetable, s, va);
+  p->shm.seg[slot] = id + 1;
+  s->refcnt++;
+  return va;
+}
+
+// unmap the segment attached in slot of process p, and drop the reference to it.
+static void detach(process *p, int slot) {
+  shm_segment *s = &segments[p->shm.seg[slot] - 1];
+  uint64 va = USER_SHM_START + (uint64)slot * SHM_SLOT_SIZE;
+
+  if (s->unit == PGSIZE) {
+    user_vm_unmap(p->pagetable, va, s->size, 0);
+  } else {
+    for (uint64 off = 0; off < s->size; off += s->unit)
+      *superpage_walk(p->pagetable, va + off) = 0;
+    flush_tlb();
+  }
+
+  p->shm.seg[slot] = 0;
+  put_segment(s);
+}
+
+//
+// attach the segment id to current process. returns its (user) address, or -1 if id does
+// not name a segment that is still linked.
+//
+uint64 do_shm_attach(int id) {
+  int i = id & ((1 << SHM_ID_SHIFT) - 1);
+  if (id < 0 || i >= SHM_MAX_SEGMENTS) return -1;
+  shm_segment *s = &segments[i];
+  if (!s->used || !s->linked || shm_id(s) != id) return -1;
+
+  for (int slot = 0; slot < SHM_MAX_ATTACH; slot++)
+    if (!current->shm.seg[slot]) return attach(current, slot, i);
+  return -1;
+}
+
+//
+// detach the segment attached at va from current process.
+//
+int do_shm_detach(uint64 va) {
+  if (va < USER_SHM_START || (va - USER_SHM_START) % SHM_SLOT_SIZE != 0) return -1;
+  uint64 slot = (va - USER_SHM_START) / SHM_SLOT_SIZE;
+  if (slot >= SHM_MAX_ATTACH || !current->shm.seg[slot]) return -1;
+
+  detach(current, slot);
+  return 0;
+}
+
+//
+// attach the segments of parent to its child of a fork, at the same addresses.
+//
+void fork_shm(process *parent, process *child) {
+  for (int slot = 0; slot < SHM_MAX_ATTACH; slot++)
+    if (parent->shm.seg[slot]) attach(child, slot, parent->shm.seg[slot] - 1);
+}
+
+//
+// detach all segments of process p, which is exiting, and unlink those it created.
+//
+void exit_shm(process *p) {
+  for (int slot = 0; slot < SHM_MAX_ATTACH; slot++)
+    if (p->shm.seg[slot]) detach(p, slot);
+  for (int i = 0; i < SHM_MAX_SEGMENTS; i++)
+    if (segments[i].used && segments[i].linked && segments[i].creator == p->pid)
+      unlink_segment(&segments[i]);
+}
@@ -0,0 +1,32 @@
+#ifndef _SHM_H_
+#define _SHM_H_
+
+#include "util/types.h"
+
+// maximum number of shared memory segments, and length of their names (with the NUL)
+#define SHM_MAX_SEGMENTS 16
+#define SHM_NAME_LEN 32
+// maximum number of segments a process can attach. the i-th attachment is mapped at
+// USER_SHM_START + i * SHM_SLOT_SIZE, which also bounds the size of a segment.
+#define SHM_MAX_ATTACH 8
+#define SHM_SLOT_SIZE (64 * 1024 * 1024)
+
+// flags of shm_create(): back the segment by superpages (SUPERPAGE_SIZE bytes each)
+#define SHM_HUGE 0x1
+
+// the segments attached by a process. seg[i] is 1 + the index of the segment attached in
+// slot i, or 0 if the slot is free.
+typedef struct shm_management_t {
+  uint8 seg[SHM_MAX_ATTACH];
+} shm_management;
+
+struct process_t;
+
+int do_shm_create(char *name, uint64 size, int flags);
+int do_shm_unlink(char *name);
+uint64 do_shm_attach(int id);
+int do_shm_detach(uint64 va);
+void fork_shm(struct process_t *parent, struct process_t *child);
+void exit_shm(struct process_t *p);
+
+#endif
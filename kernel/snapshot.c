@@ -0,0 +1,162 @@
+/*
+ * boot snapshot. a run with the kernel option --snapshot-save=<host file> writes the
+ * kernel state, as it is right before the app is loaded, to the host file: the writable
+ * kernel data (.data and .bss, from _fdata), the pages allocated so far (up to the pmm
+ * frontier, e.g., the kernel page table) and the initrd. later runs with
+ * --snapshot=<host file> read the state back with one bulk read (plus one for the initrd),
+ * and skip the rest of booting, i.e., init_dtb() and everything s_start() does before
+ * loading the app (the kernel options, the initrd, pmm_init() and kern_vm_init()).
+ *
+ * restoring takes two steps in M mode. snapshot_load() reads the kernel memory to a staging
+ * area at the top of the memory, and snapshot_restore() copies it into place right before
+ * entering S mode at s_resume() (kernel/kernel.c). the copy overwrites the stack it runs on,
+ * so it is done by snapshot_enter() (kernel/machine/mentry.S) with registers only.
+ *
+ * the M-mode CSRs are set up by m_start() in every run, the S-mode state (e.g., the kernel
+ * page table behind satp) is in the restored memory. the kernel options of the run that
+ * took the snapshot stay in effect, and the restoring run only names the app. a snapshot
+ * fits only the kernel binary it is taken from (which is checked), run by spike with the
+ * same options (e.g., -m, which is not).
+ */
+
+#include "snapshot.h"
+#include "config.h"
+#include "riscv.h"
+#include "pmm.h"
+#include "boottime.h"
+#include "elf.h"
+#include "string.h"
+#include "util/functions.h"
+
+#include "spike_interface/spike_utils.h"
+#include "spike_interface/spike_initrd.h"
+
+// defined in kernel/kernel.lds
+extern char _etext[], _fdata[];
+// defined in spike_interface/spike_memory.c
+extern uint64 g_mem_size;
+// defined in kernel/machine/mentry.S
+extern void snapshot_enter(uint64 dst, uint64 src, uint64 len);
+
+static char save_path[128];
+
+// the snapshot read by snapshot_load(), and where its kernel memory is staged
+static snapshot_header loaded;
+static uint64 staging;
+
+//
+// FNV-1a hash of the kernel code, which tells kernel binaries apart.
+//
+static uint64 kernel_id(void) {
+  uint64 h = 14695981039346656037ULL;
+  for (uint64 *p = (uint64 *)KERN_BASE; p < (uint64 *)_etext; p++)
+    h = (h ^ *p) * 1099511628211ULL;
+  return h;
+}
+
+//
+// the staging area of the kernel memory [start, end): the top of the memory managed by
+// the pmm, which no run allocates before the app is loaded. returns 0 if it does not fit.
+//
+static uint64 staging_area(uint64 mem_size, uint64 start, uint64 end) {
+  uint64 top = MIN(PHYS_TOP, DRAM_BASE + mem_size);
+  if (end - start > top - end) return 0;
+  return ROUNDDOWN(top - (end - start), PGSIZE);
+}
+
+//
+// ask for a snapshot to be written to the host file path before the app is loaded.
+//
+int snapshot_request_save(const char *path) {
+  if (strlen(path) >= sizeof(save_path)) return -1;
+  strcpy(save_path, path);
+  return 0;
+}
+
+//
+// write the snapshot, if it is asked for. called by s_start() right before loading the app.
+//
+void snapshot_save(void) {
+  if (!save_path[0]) return;
+
+  snapshot_header hdr;
+  memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof(hdr.magic));
+  hdr.kernel_id = kernel_id();
+  hdr.mem_size = g_mem_size;
+  hdr.start = (uint64)_fdata;
+  hdr.end = pmm_frontier();
+  if (initrd_range(&hdr.initrd_start, &hdr.initrd_end) != 0) hdr.initrd_start = hdr.initrd_end = 0;
+
+  // the kernel memory is copied aside first, and written from the copy: the writes below
+  // take locks and change the state of the spike files, none of which may be in the
+  // snapshot.
+  uint64 stage = staging_area(g_mem_size, hdr.start, hdr.end);
+  if (!stage) panic("snapshot: no room to stage %ld bytes.\n", hdr.end - hdr.start);
+  memcpy((void *)stage, (void *)hdr.start, hdr.end - hdr.start);
+
+  spike_file_t *f = spike_file_open(save_path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (IS_ERR_VALUE(f)) panic("snapshot: fail on opening %s.\n", save_path);
+  spike_file_write(f, &hdr, sizeof(hdr));
+  spike_file_write(f, (void *)stage, hdr.end - hdr.start);
+  spike_file_write(f, (void *)hdr.initrd_start, hdr.initrd_end - hdr.initrd_start);
+  spike_file_close(f);
+
+  sprint("snapshot: %ld bytes of kernel memory written to %s.\n", hdr.end - hdr.start,
+         save_path);
+}
+
+//
+// with the kernel option --snapshot=<host file>, read the snapshot: the initrd to its
+// place, and the kernel memory to the staging area. returns 1 if snapshot_restore() may
+// go on, or 0 to boot as usual. called by m_start().
+//
+int snapshot_load(void) {
+  char path[128];
+  if (cmdline_option(SNAPSHOT_OPT, path, sizeof(path)) != 0) return 0;
+
+  spike_file_t *f = spike_file_open(path, O_RDONLY, 0);
+  if (IS_ERR_VALUE(f)) {
+    sprint("snapshot: fail on opening %s, booting as usual.\n", path);
+    return 0;
+  }
+
+  int ok = 0;
+  snapshot_header *hdr = &loaded;
+  if (spike_file_pread_direct(f, hdr, sizeof(*hdr), 0) != sizeof(*hdr) ||
+      strncmp(hdr->magic, SNAPSHOT_MAGIC, sizeof(hdr->magic)) != 0 ||
+      hdr->start != (uint64)_fdata || hdr->kernel_id != kernel_id()) {
+    sprint("snapshot: %s is not taken from this kernel, booting as usual.\n", path);
+    goto out;
+  }
+
+  uint64 len = hdr->end - hdr->start, initrd_len = hdr->initrd_end - hdr->initrd_start;
+  staging = staging_area(hdr->mem_size, hdr->start, hdr->end);
+  // the one bulk read of the kernel memory.
+  if (!staging || spike_file_pread_direct(f, (void *)staging, len, sizeof(*hdr)) != len) {
+    sprint("snapshot: fail on reading %s, booting as usual.\n", path);
+    goto out;
+  }
+  if (initrd_len && spike_file_pread_direct(f, (void *)hdr->initrd_start, initrd_len,
+                                            sizeof(*hdr) + len) != initrd_len) {
+    sprint("snapshot: fail on reading the initrd in %s, booting as usual.\n", path);
+    goto out;
+  }
+  ok = 1;
+
+out:
+  spike_file_close(f);
+  return ok;
+}
+
+//
+// put the kernel memory loaded by snapshot_load() into place, and enter S mode at mepc
+// (i.e., s_resume()). never returns. called by m_start() once the M-mode CSRs are set.
+//
+void snapshot_restore(void) {
+  // the restored kernel reports the boot phases of this run, rather than those of the run
+  // that took the snapshot.
+  memcpy((void *)(staging + ((uint64)boot_stamps - loaded.start)), boot_stamps,
+         sizeof(boot_stamps));
+
+  snapshot_enter(loaded.start, staging, ROUNDUP(loaded.end - loaded.start, 8));
+}
@@ -0,0 +1,26 @@
+#ifndef _SNAPSHOT_H_
+#define _SNAPSHOT_H_
+
+#include "util/types.h"
+
+// layout of a snapshot file: the header, the kernel memory [start, end), then the initrd
+// [initrd_start, initrd_end) if there is one.
+#define SNAPSHOT_MAGIC "PKESNAP1"
+typedef struct snapshot_header_t {
+  char magic[8];
+  uint64 kernel_id;   // hash of the kernel code, a snapshot fits only the kernel it is from
+  uint64 mem_size;    // g_mem_size of the run that took the snapshot
+  uint64 start, end;  // the writable kernel data, and the pages allocated by the pmm
+  uint64 initrd_start, initrd_end;
+} snapshot_header;
+
+// kernel options
+#define SNAPSHOT_OPT "--snapshot="
+#define SNAPSHOT_SAVE_OPT "--snapshot-save="
+
+int snapshot_request_save(const char *path);
+void snapshot_save(void);
+int snapshot_load(void);
+void snapshot_restore(void);
+
+#endif
@@ -6,6 +6,10 @@
 #include "process.h"
 #include "strap.h"
 #include "syscall.h"
+#include "mmap.h"
+#include "proc_file.h"
+#include "timer.h"
+#include "trace.h"
 
 #include "spike_interface/spike_utils.h"
 
@@ -18,22 +22,59 @@ static void handle_syscall(trapframe *tf) {
   // in RV64G, each instruction occupies exactly 32 bits (i.e., 4 Bytes)
   tf->epc += 4;
 
-  // TODO (lab1_1): remove the panic call below, and call do_syscall (defined in
-  // kernel/syscall.c) to conduct real operations of the kernel side for a syscall.
-  // IMPORTANT: return value should be returned to user app, or else, you will encounter
-  // problems in later experiments!
-  if(do_syscall(tf->regs.a0,tf->regs.a1,tf->regs.a2,
-    tf->regs.a3,tf->regs.a4,tf->regs.a5,tf->regs.a6,tf->regs.a7)!=0){
-      panic("do_syscall failed");
-  }
+  // call do_syscall (defined in kernel/syscall.c) to conduct real operations of the kernel
+  // side for a syscall. the return value (e.g., the number of bytes read by SYS_user_read)
+  // is passed back to the user app in its a0 register.
+  long num = tf->regs.a0;
+  TRACE(TRACE_SYSCALL_BEGIN, num, tf->regs.a1);
+  tf->regs.a0 = do_syscall(tf->regs.a0, tf->regs.a1, tf->regs.a2, tf->regs.a3, tf->regs.a4,
+                           tf->regs.a5, tf->regs.a6, tf->regs.a7);
+  TRACE(TRACE_SYSCALL_END, num, tf->regs.a0);
 
 }
 
+// the number of timer interrupts since boot
+static uint64 g_ticks = 0;
+
 //
-// kernel/smode_trap.S will pass control to smode_trap_handler, when a trap happens
-// in S-mode.
+// handling a timer interrupt, which the M-mode timer handler forwards as an S-mode software
+// interrupt once the deadline asked for is reached. also called by the idle loop of
+// schedule().
 //
-void smode_trap_handler(void) {
+void handle_mtimer_trap() {
+  g_ticks++;
+  // clear the S-mode software interrupt pending bit.
+  write_csr(sip, read_csr(sip) & ~SIP_SSIP);
+
+  // run the expired timers (e.g., waking up sleeping processes). timer_run() is defined
+  // in kernel/timer.c
+  timer_run();
+
+  // gather the console input, and wake up the processes waiting for it.
+  // poll_console() is defined in kernel/proc_file.c
+  poll_console();
+
+  // ask for the interrupt at the next deadline.
+  timer_reprogram();
+}
+
+//
+// handling user page faults. pages of mmap() areas and of the heap are filled when they are
+// first touched, any other fault is an illegal access of the app.
+//
+static void handle_user_page_fault(uint64 mcause, uint64 sepc, uint64 stval) {
+  TRACE(TRACE_PAGE_FAULT, stval, mcause);
+  // handle_user_fault() is defined in kernel/mmap.c
+  if (handle_user_fault(current, stval, mcause == CAUSE_STORE_PAGE_FAULT) == 0) return;
+
+  sprint("handle_page_fault: illegal access to 0x%lx, sepc=0x%lx\n", stval, sepc);
+  panic("unhandled page fault (scause %ld).\n", mcause);
+}
+
+//
+// the first steps of handling any trap from the app.
+//
+static void enter_trap(void) {
   // make sure we are in User mode before entering the trap handling.
   // we will consider other previous case in lab1_3 (interrupt).
   if ((read_csr(sstatus) & SSTATUS_SPP) != 0) panic("usertrap: not from user mode");
@@ -41,11 +82,74 @@ void smode_trap_handler(void) {
   assert(current);
   // save user process counter.
   current->trapframe->epc = read_csr(sepc);
+  // stop charging the hardware counters to the process. defined in kernel/perf.c
+  perf_switch_out(&current->perf);
+  TRACE(TRACE_TRAP_BEGIN, read_csr(scause), current->trapframe->epc);
+
+  // print what the app has put into its console output ring so far, before handling
+  // anything that might print too. drain_print_ring() is defined in kernel/proc_file.c
+  drain_print_ring(current);
+}
+
+//
+// the last steps of the fast paths, which resume the app with sret right after their
+// handlers (in kernel/strap_vector.S), rather than through switch_to().
+//
+static void leave_trap(void) {
+  TRACE(TRACE_TRAP_END, current->pid, 0);
+  perf_switch_in(&current->perf);
+  write_csr(sepc, current->trapframe->epc);
+}
+
+//
+// kernel/strap_vector.S passes control to smode_syscall_handler, when the app makes a
+// syscall. the full context of the app is saved, as the syscall may give up the cpu.
+//
+void smode_syscall_handler(void) {
+  enter_trap();
+  handle_syscall(current->trapframe);
+
+  // continue (come back to) the execution of current process.
+  switch_to(current);
+}
+
+//
+// kernel/strap_vector.S calls smode_fault_handler on page faults of the app. only the
+// caller-saved registers of the app are saved, and the app resumes when it returns.
+//
+void smode_fault_handler(void) {
+  enter_trap();
+  handle_user_page_fault(read_csr(scause), read_csr(sepc), read_csr(stval));
+  leave_trap();
+}
+
+//
+// kernel/strap_vector.S calls smode_interrupt_handler on timer ticks (S-mode software
+// interrupts) that interrupt the app. like smode_fault_handler, it returns to the app.
+//
+void smode_interrupt_handler(void) {
+  enter_trap();
+  handle_mtimer_trap();
+  leave_trap();
+}
+
+//
+// kernel/strap_vector.S passes control to smode_trap_handler, when a trap without a path
+// of its own happens in S-mode.
+//
+void smode_trap_handler(void) {
+  enter_trap();
 
   // if the cause of trap is syscall from user application.
   // read_csr() and CAUSE_USER_ECALL are macros defined in kernel/riscv.h
-  if (read_csr(scause) == CAUSE_USER_ECALL) {
+  uint64 cause = read_csr(scause);
+  if (cause == CAUSE_USER_ECALL) {
     handle_syscall(current->trapframe);
+  } else if (cause == CAUSE_MTIMER_S_TRAP) {
+    handle_mtimer_trap();
+  } else if (cause == CAUSE_LOAD_PAGE_FAULT || cause == CAUSE_STORE_PAGE_FAULT ||
+             cause == CAUSE_FETCH_PAGE_FAULT) {
+    handle_user_page_fault(cause, read_csr(sepc), read_csr(stval));
   } else {
     sprint("smode_trap_handler(): unexpected scause %p\n", read_csr(scause));
     sprint("            sepc=%p stval=%p\n", read_csr(sepc), read_csr(stval));
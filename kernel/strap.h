@@ -2,5 +2,9 @@
 #define _STRAP_H_
 
 void smode_trap_handler(void);
+void smode_syscall_handler(void);
+void smode_fault_handler(void);
+void smode_interrupt_handler(void);
+void handle_mtimer_trap(void);
 
 #endif
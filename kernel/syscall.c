@@ -9,16 +9,24 @@
 #include "syscall.h"
 #include "string.h"
 #include "process.h"
+#include "proc_file.h"
+#include "mmap.h"
+#include "perf.h"
+#include "futex.h"
+#include "shm.h"
+#include "timer.h"
 #include "util/functions.h"
 
 #include "spike_interface/spike_utils.h"
+#include "spike_interface/spike_pcache.h"
 
 //
 // implement the SYS_user_print syscall
 //
 ssize_t sys_user_print(const char* buf, size_t n) {
-  sprint(buf);
-  return 0;
+  // the string goes to the console straight from the user pages (rather than through the
+  // buffer of vprintk()). do_print() is defined in kernel/proc_file.c
+  return do_print((char*)buf, n) < 0 ? -1 : 0;
 }
 
 //
@@ -26,9 +34,205 @@ ssize_t sys_user_print(const char* buf, size_t n) {
 //
 ssize_t sys_user_exit(uint64 code) {
   sprint("User exit with code:%d.\n", code);
-  // in lab1, PKE considers only one app (one process). 
-  // therefore, shutdown the system when the app calls exit()
-  shutdown(code);
+  // do_exit() is defined in kernel/process.c. the system shuts down when the last process
+  // exits.
+  do_exit(code);
+  return 0;
+}
+
+//
+// implement the SYS_user_open syscall
+//
+ssize_t sys_user_open(char* pathname, int flags, int mode) {
+  return do_open(pathname, flags, mode);
+}
+
+//
+// implement the SYS_user_read syscall
+//
+ssize_t sys_user_read(int fd, char* buf, uint64 count) {
+  return do_read(fd, buf, count);
+}
+
+//
+// implement the SYS_user_write syscall
+//
+ssize_t sys_user_write(int fd, char* buf, uint64 count) {
+  return do_write(fd, buf, count);
+}
+
+//
+// implement the SYS_user_pread syscall
+//
+ssize_t sys_user_pread(int fd, char* buf, uint64 count, uint64 offset) {
+  return do_pread(fd, buf, count, offset);
+}
+
+//
+// implement the SYS_user_close syscall
+//
+ssize_t sys_user_close(int fd) {
+  return do_close(fd);
+}
+
+//
+// implement the SYS_user_lseek syscall
+//
+ssize_t sys_user_lseek(int fd, int64 offset, int whence) {
+  return do_lseek(fd, offset, whence);
+}
+
+//
+// implement the SYS_user_fstat syscall
+//
+ssize_t sys_user_fstat(int fd, struct stat* st) {
+  return do_fstat(fd, st);
+}
+
+//
+// implement the SYS_user_fsync syscall
+//
+ssize_t sys_user_fsync(int fd) {
+  return do_fsync(fd);
+}
+
+//
+// implement the SYS_user_pcache_stat syscall, copies the page cache counters to st
+//
+ssize_t sys_user_pcache_stat(pcache_stats* st) {
+  pcache_stats kst;
+  pcache_get_stats(&kst);
+  return copy_to_user(current, (uint64)st, &kst, sizeof(kst));
+}
+
+//
+// implement the SYS_user_mmap syscall
+//
+ssize_t sys_user_mmap(uint64 addr, uint64 length, int prot, int flags, int fd, uint64 offset) {
+  return do_mmap(addr, length, prot, flags, fd, offset);
+}
+
+//
+// implement the SYS_user_munmap syscall
+//
+ssize_t sys_user_munmap(uint64 addr, uint64 length) {
+  return do_munmap(addr, length);
+}
+
+//
+// implement the SYS_user_print_ring syscall, which maps a console output ring into the app.
+// returns its (user) address.
+//
+ssize_t sys_user_print_ring() {
+  return do_print_ring();
+}
+
+//
+// implement the SYS_user_print_flush syscall. the ring of the app has already been drained
+// when it trapped into the kernel, nothing remains to be done.
+//
+ssize_t sys_user_print_flush() {
+  return 0;
+}
+
+//
+// implement the SYS_user_perf syscall, operation op (see util/perf_events.h) on counter of
+// the current process.
+//
+ssize_t sys_user_perf(int op, int counter) {
+  return do_perf(op, counter);
+}
+
+//
+// implement the SYS_user_getpid syscall
+//
+ssize_t sys_user_getpid() {
+  return current->pid;
+}
+
+//
+// implement the SYS_user_futex_wait syscall
+//
+ssize_t sys_user_futex_wait(uint64 addr, int expected) {
+  return do_futex_wait(addr, expected);
+}
+
+//
+// implement the SYS_user_futex_wake syscall
+//
+ssize_t sys_user_futex_wake(uint64 addr, int n) {
+  return do_futex_wake(addr, n);
+}
+
+//
+// implement the SYS_user_fork syscall
+//
+ssize_t sys_user_fork() {
+  return do_fork();
+}
+
+//
+// implement the SYS_user_wait syscall
+//
+ssize_t sys_user_wait(int pid, int* code) {
+  return do_wait(pid, (uint64)code);
+}
+
+//
+// implement the SYS_user_pipe syscall
+//
+ssize_t sys_user_pipe(int* fds) {
+  return do_pipe(fds);
+}
+
+//
+// implement the SYS_user_vmsplice syscall
+//
+ssize_t sys_user_vmsplice(int fd, char* buf, uint64 count) {
+  return do_vmsplice(fd, buf, count);
+}
+
+//
+// implement the SYS_user_shm_create syscall
+//
+ssize_t sys_user_shm_create(char* name, uint64 size, int flags) {
+  return do_shm_create(name, size, flags);
+}
+
+//
+// implement the SYS_user_shm_unlink syscall
+//
+ssize_t sys_user_shm_unlink(char* name) {
+  return do_shm_unlink(name);
+}
+
+//
+// implement the SYS_user_shm_attach syscall
+//
+ssize_t sys_user_shm_attach(int id) {
+  return do_shm_attach(id);
+}
+
+//
+// implement the SYS_user_shm_detach syscall
+//
+ssize_t sys_user_shm_detach(uint64 addr) {
+  return do_shm_detach(addr);
+}
+
+//
+// implement the SYS_user_brk syscall
+//
+ssize_t sys_user_brk(uint64 addr) {
+  return do_brk(addr);
+}
+
+//
+// implement the SYS_user_nanosleep syscall
+//
+ssize_t sys_user_nanosleep(uint64 ns) {
+  // do_nanosleep() is defined in kernel/timer.c
+  return do_nanosleep(ns);
 }
 
 //
@@ -41,6 +245,60 @@ long do_syscall(long a0, long a1, long a2, long a3, long a4, long a5, long a6, l
       return sys_user_print((const char*)a1, a2);
     case SYS_user_exit:
       return sys_user_exit(a1);
+    case SYS_user_open:
+      return sys_user_open((char*)a1, a2, a3);
+    case SYS_user_read:
+      return sys_user_read(a1, (char*)a2, a3);
+    case SYS_user_write:
+      return sys_user_write(a1, (char*)a2, a3);
+    case SYS_user_pread:
+      return sys_user_pread(a1, (char*)a2, a3, a4);
+    case SYS_user_close:
+      return sys_user_close(a1);
+    case SYS_user_lseek:
+      return sys_user_lseek(a1, a2, a3);
+    case SYS_user_fstat:
+      return sys_user_fstat(a1, (struct stat*)a2);
+    case SYS_user_fsync:
+      return sys_user_fsync(a1);
+    case SYS_user_pcache_stat:
+      return sys_user_pcache_stat((pcache_stats*)a1);
+    case SYS_user_mmap:
+      return sys_user_mmap(a1, a2, a3, a4, a5, a6);
+    case SYS_user_munmap:
+      return sys_user_munmap(a1, a2);
+    case SYS_user_print_ring:
+      return sys_user_print_ring();
+    case SYS_user_print_flush:
+      return sys_user_print_flush();
+    case SYS_user_perf:
+      return sys_user_perf(a1, a2);
+    case SYS_user_getpid:
+      return sys_user_getpid();
+    case SYS_user_futex_wait:
+      return sys_user_futex_wait(a1, a2);
+    case SYS_user_futex_wake:
+      return sys_user_futex_wake(a1, a2);
+    case SYS_user_fork:
+      return sys_user_fork();
+    case SYS_user_wait:
+      return sys_user_wait(a1, (int*)a2);
+    case SYS_user_pipe:
+      return sys_user_pipe((int*)a1);
+    case SYS_user_vmsplice:
+      return sys_user_vmsplice(a1, (char*)a2, a3);
+    case SYS_user_shm_create:
+      return sys_user_shm_create((char*)a1, a2, a3);
+    case SYS_user_shm_unlink:
+      return sys_user_shm_unlink((char*)a1);
+    case SYS_user_shm_attach:
+      return sys_user_shm_attach(a1);
+    case SYS_user_shm_detach:
+      return sys_user_shm_detach(a1);
+    case SYS_user_brk:
+      return sys_user_brk(a1);
+    case SYS_user_nanosleep:
+      return sys_user_nanosleep(a1);
     default:
       panic("Unknown syscall %ld \n", a0);
   }
@@ -0,0 +1,244 @@
+/*
+ * the timers of the kernel, kept in a hierarchical timer wheel, and the tickless timer
+ * interrupt that serves them.
+ *
+ * the wheel has WHEEL_LEVELS levels of WHEEL_SLOTS slots. a slot of level 0 holds the
+ * timers of one tick (TIMER_WHEEL_TICK mtime units), a slot of level l spans WHEEL_SLOTS
+ * times as much as a slot of level l-1. a timer goes to the lowest level whose window (the
+ * WHEEL_SLOTS slots around wheel_now) contains its expiry, and the timers of a slot of a
+ * higher level are moved down (cascaded) once wheel_now reaches the slot. timers beyond
+ * the top level wait on a list of their own.
+ *
+ * the wheel does not advance tick by tick: a bitmap per level tells which slots hold
+ * timers, and the wheel jumps from one expiry or cascade to the next. so the cost of
+ * running the timers depends on how many there are, not on how much time has passed.
+ *
+ * the timer interrupt is tickless: mtimecmp is programmed (through M mode, see
+ * kernel/machine/mtrap.c) for the next event of the wheel only, or for the next console
+ * poll while processes wait for console input or may run with a console output ring (which
+ * is drained on the trap). a hart with nothing to do sleeps in wfi.
+ */
+
+#include "timer.h"
+#include "config.h"
+#include "riscv.h"
+#include "process.h"
+#include "sched.h"
+#include "proc_file.h"
+#include "util/functions.h"
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define WHEEL_LEVELS 4
+#define LEVEL_SHIFT(l) ((l) * WHEEL_BITS)
+// the span of the whole wheel is 1 << WHEEL_SHIFT ticks
+#define WHEEL_SHIFT LEVEL_SHIFT(WHEEL_LEVELS)
+
+static wheel_timer *slots[WHEEL_LEVELS][WHEEL_SLOTS];
+// bit s of occupied[l] is set if slots[l][s] holds timers
+static uint64 occupied[WHEEL_LEVELS];
+// the timers beyond the top level
+static wheel_timer *far_timers;
+// the time (in ticks) the wheel has reached, no pending timer expires before it
+static uint64 wheel_now;
+
+// the deadline (in mtime units) programmed last, -1 for none
+static uint64 programmed = -1;
+
+// processes sleeping in do_nanosleep(), each with its own process as wait_key
+static wait_queue sleepers;
+
+static void list_push(wheel_timer **head, wheel_timer *t) {
+  t->next = *head;
+  if (*head) (*head)->pprev = &t->next;
+  t->pprev = head;
+  *head = t;
+}
+
+//
+// put pending timer t into the slot of its expiry, relative to wheel_now.
+//
+static void place(wheel_timer *t) {
+  uint64 e = MAX(t->expires, wheel_now);
+  for (int l = 0; l < WHEEL_LEVELS; l++) {
+    if ((e >> LEVEL_SHIFT(l + 1)) != (wheel_now >> LEVEL_SHIFT(l + 1))) continue;
+    int s = (e >> LEVEL_SHIFT(l)) & (WHEEL_SLOTS - 1);
+    t->slot = l * WHEEL_SLOTS + s;
+    list_push(&slots[l][s], t);
+    occupied[l] |= 1UL << s;
+    return;
+  }
+  t->slot = -1;
+  list_push(&far_timers, t);
+}
+
+//
+// init timer t, which calls fn once it expires. data is left for fn.
+//
+void timer_init(wheel_timer *t, void (*fn)(wheel_timer *), void *data) {
+  t->pprev = NULL;
+  t->fn = fn;
+  t->data = data;
+}
+
+//
+// arm timer t to expire at time when (in mtime units), which is rounded up to a tick.
+//
+void timer_add(wheel_timer *t, uint64 when) {
+  if (timer_pending(t)) timer_del(t);
+  t->expires = ROUNDUP(when, TIMER_WHEEL_TICK) / TIMER_WHEEL_TICK;
+  place(t);
+}
+
+//
+// disarm timer t, if it is pending.
+//
+void timer_del(wheel_timer *t) {
+  if (!timer_pending(t)) return;
+  *t->pprev = t->next;
+  if (t->next) t->next->pprev = t->pprev;
+  t->pprev = NULL;
+
+  if (t->slot >= 0) {
+    int l = t->slot / WHEEL_SLOTS, s = t->slot % WHEEL_SLOTS;
+    if (!slots[l][s]) occupied[l] &= ~(1UL << s);
+  }
+}
+
+//
+// the time (in ticks) of the next event of the wheel, i.e., an expiry (level 0) or a
+// cascade (higher levels). returns -1 if no timer is pending.
+//
+static uint64 next_event(void) {
+  uint64 next = -1;
+  for (int l = 0; l < WHEEL_LEVELS; l++) {
+    int cur = (wheel_now >> LEVEL_SHIFT(l)) & (WHEEL_SLOTS - 1);
+    uint64 bits = occupied[l] & ~((1UL << cur) - 1);
+    if (!bits) continue;
+    uint64 window = wheel_now >> LEVEL_SHIFT(l + 1) << LEVEL_SHIFT(l + 1);
+    uint64 t = window | ((uint64)__builtin_ctzl(bits) << LEVEL_SHIFT(l));
+    next = MIN(next, MAX(t, wheel_now));
+  }
+  // the timers beyond the wheel are placed again once the wheel turns over.
+  if (far_timers) next = MIN(next, ((wheel_now >> WHEEL_SHIFT) + 1) << WHEEL_SHIFT);
+  return next;
+}
+
+// take all the timers off list head, and return them.
+static wheel_timer *list_take(wheel_timer **head) {
+  wheel_timer *list = *head;
+  *head = NULL;
+  return list;
+}
+
+//
+// advance the wheel to time now (in ticks), expiring the timers due by then. the wheel
+// stops only at the events, from the top level down: the timers of the slots reached are
+// cascaded, and those of the level-0 slot reached expire.
+//
+static void advance(uint64 now) {
+  for (uint64 t; (t = next_event()) <= now;) {
+    wheel_now = t;
+
+    if ((t & ((1UL << WHEEL_SHIFT) - 1)) == 0) {
+      for (wheel_timer *p = list_take(&far_timers), *next; p; p = next) {
+        next = p->next;
+        place(p);
+      }
+    }
+
+    for (int l = WHEEL_LEVELS - 1; l >= 0; l--) {
+      int s = (t >> LEVEL_SHIFT(l)) & (WHEEL_SLOTS - 1);
+      if (!(occupied[l] & (1UL << s))) continue;
+      occupied[l] &= ~(1UL << s);
+      for (wheel_timer *p = list_take(&slots[l][s]), *next; p; p = next) {
+        next = p->next;
+        if (l > 0) {
+          place(p);
+        } else {
+          // fn may arm the timer again.
+          p->pprev = NULL;
+          p->fn(p);
+        }
+      }
+    }
+  }
+  wheel_now = MAX(wheel_now, now);
+}
+
+//
+// run the timers that have expired. called on timer interrupts.
+//
+void timer_run(void) {
+  // the interrupt consumed the deadline programmed.
+  programmed = -1;
+  advance(read_time() / TIMER_WHEEL_TICK);
+}
+
+// ask M mode for a timer interrupt at deadline (in mtime units, -1 for none).
+static void sbi_set_timer(uint64 deadline) {
+  programmed = deadline;
+  register uint64 a0 asm("a0") = deadline;
+  register uint64 a7 asm("a7") = SBI_SET_TIMER;
+  asm volatile("ecall" : "+r"(a0) : "r"(a7) : "memory");
+}
+
+//
+// program the timer interrupt for the next deadline: the next event of the wheel, or the
+// next console poll while processes wait for console input or may fill a console output
+// ring (see util/print_ring.h) without trapping. called whenever the next deadline may have
+// changed, i.e., after a timer interrupt and before running a process (see schedule()).
+// M mode is only called if the deadline does change.
+//
+void timer_reprogram(void) {
+  uint64 next = next_event();
+  uint64 deadline = next == -1 ? -1 : next * TIMER_WHEEL_TICK;
+
+  // console_has_readers() and print_rings_in_use() are defined in kernel/proc_file.c
+  if (console_has_readers() || print_rings_in_use()) {
+    // a deadline programmed already will do, if it comes before the poll is due.
+    uint64 poll = read_time() + TIMER_INTERVAL;
+    if (programmed <= MIN(deadline, poll)) return;
+    deadline = MIN(deadline, poll);
+  }
+  if (deadline != programmed) sbi_set_timer(deadline);
+}
+
+//
+// start the (tickless) timer interrupt, at boot. there is no deadline yet, but M mode is
+// called anyway: it may have the samples of the profiler to take.
+//
+void timer_start(void) {
+  wheel_now = read_time() / TIMER_WHEEL_TICK;
+  sbi_set_timer(-1);
+}
+
+/* --- sleeping --- */
+static void sleep_timeout(wheel_timer *t) {
+  process *p = t->data;
+  wakeup_key(&sleepers, (uint64)p, 1);
+}
+
+//
+// sleep (at least) ns nanoseconds. returns 0.
+//
+long do_nanosleep(uint64 ns) {
+  wheel_timer *t = &current->sleep_timer;
+  if (current->sleeping) {
+    // a woken process re-issues the syscall: it is done, unless the timer is still pending.
+    if (!timer_pending(t)) {
+      current->sleeping = 0;
+      return 0;
+    }
+  } else {
+    if (ns == 0) return 0;
+    timer_init(t, sleep_timeout, current);
+    timer_add(t, read_time() + ns / (1000000000 / TIMEBASE_FREQ));
+    current->sleeping = 1;
+  }
+
+  // sleep_on() is defined in kernel/sched.c, and never returns.
+  current->wait_key = (uint64)current;
+  sleep_on(&sleepers);
+  return 0;
+}
@@ -0,0 +1,33 @@
+#ifndef _TIMER_H_
+#define _TIMER_H_
+
+#include "util/types.h"
+
+// a timer of the timer wheel, which calls fn (with the timer) once it expires
+typedef struct wheel_timer_t {
+  uint64 expires;  // in ticks of the wheel (TIMER_WHEEL_TICK mtime units)
+  struct wheel_timer_t *next, **pprev;  // the list of a slot, pprev is NULL when not pending
+  int16 slot;  // index of the slot in the wheel, or -1 beyond the wheel
+  void (*fn)(struct wheel_timer_t *t);
+  void *data;
+} wheel_timer;
+
+// the current time (the time csr), in mtime units
+static inline uint64 read_time(void) {
+  uint64 x;
+  asm volatile("rdtime %0" : "=r"(x));
+  return x;
+}
+
+void timer_init(wheel_timer *t, void (*fn)(wheel_timer *), void *data);
+void timer_add(wheel_timer *t, uint64 when);
+void timer_del(wheel_timer *t);
+static inline int timer_pending(wheel_timer *t) { return t->pprev != NULL; }
+
+void timer_run(void);
+void timer_reprogram(void);
+void timer_start(void);
+
+long do_nanosleep(uint64 ns);
+
+#endif
@@ -0,0 +1,118 @@
+/*
+ * binary event tracer. when the kernel is built with -DPKE_TRACE and is started with the
+ * kernel option --trace=<host file>, each tracepoint (the TRACE macro) appends a fixed-size,
+ * timestamped record to the ring buffer of its hart. a hart is the only writer of its ring,
+ * so recording takes no lock. full rings are flushed to the host file, and so are the
+ * remaining records at shutdown. tools/pke_trace.py turns the file into Chrome trace JSON.
+ */
+
+#include "trace.h"
+#include "config.h"
+#include "riscv.h"
+#include "process.h"
+#include "string.h"
+#include "util/functions.h"
+
+#include "spike_interface/spike_utils.h"
+
+#ifdef PKE_TRACE
+
+typedef struct trace_ring_t {
+  trace_rec recs[TRACE_RING_SIZE];
+  // free-running: recs[head % TRACE_RING_SIZE] is the oldest record not flushed yet, and
+  // recs[tail % TRACE_RING_SIZE] is where the next one goes.
+  uint64 head, tail;
+  uint64 dropped;  // records lost while the ring was being flushed
+  int flushing;
+} trace_ring;
+
+static trace_ring rings[NCPU];
+static spike_file_t *trace_file = NULL;
+static volatile int g_tracing = 0;
+
+//
+// turn on tracing, the records go to the host file path.
+//
+int trace_start(const char *path) {
+  spike_file_t *f = spike_file_open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (IS_ERR_VALUE(f)) return -1;
+
+  trace_header hdr;
+  memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+  hdr.rec_size = sizeof(trace_rec);
+  hdr.nharts = NCPU;
+  spike_file_write(f, &hdr, sizeof(hdr));
+
+  trace_file = f;
+  g_tracing = 1;
+  return 0;
+}
+
+//
+// write the records of ring to the host file, as one chunk.
+//
+static void flush_ring(int hartid, trace_ring *ring) {
+  // the host writes below pass the HTIF tracepoints, whose records would land in the very
+  // ring being flushed. they are dropped (and counted) instead.
+  ring->flushing = 1;
+
+  uint64 n = ring->tail - ring->head;
+  uint64 chunk[3] = {hartid, n, ring->dropped};
+  ring->dropped = 0;
+  spike_file_write(trace_file, chunk, sizeof(chunk));
+
+  uint64 pos = ring->head % TRACE_RING_SIZE;
+  uint64 first = MIN(n, TRACE_RING_SIZE - pos);
+  spike_file_write(trace_file, &ring->recs[pos], first * sizeof(trace_rec));
+  if (n > first) spike_file_write(trace_file, ring->recs, (n - first) * sizeof(trace_rec));
+
+  ring->head = ring->tail;
+  ring->flushing = 0;
+}
+
+//
+// record an event. called by the TRACE macro.
+//
+void trace_event(int event, uint64 a0, uint64 a1) {
+  if (!g_tracing) return;
+  // PKE runs on one hart (NCPU), which is hart 0.
+  int hartid = 0;
+  trace_ring *ring = &rings[hartid];
+
+  if (ring->flushing) {
+    ring->dropped++;
+    return;
+  }
+  if (ring->tail - ring->head == TRACE_RING_SIZE) flush_ring(hartid, ring);
+
+  trace_rec *r = &ring->recs[ring->tail % TRACE_RING_SIZE];
+  r->ts = read_csr(cycle);
+  r->event = event;
+  r->hart = hartid;
+  r->pid = current ? current->pid : (uint32)-1;
+  r->a0 = a0;
+  r->a1 = a1;
+  ring->tail++;
+}
+
+//
+// flush the remaining records, and turn tracing off. called before shutdown.
+//
+void trace_dump(void) {
+  if (!g_tracing) return;
+  g_tracing = 0;
+
+  for (int i = 0; i < NCPU; i++)
+    if (rings[i].tail != rings[i].head || rings[i].dropped) flush_ring(i, &rings[i]);
+  spike_file_close(trace_file);
+  sprint("trace: records written to the host.\n");
+}
+
+#else
+
+// without PKE_TRACE, there are no tracepoints to record.
+void trace_event(int event, uint64 a0, uint64 a1) {}
+int trace_start(const char *path) { return -1; }
+void trace_dump(void) {}
+
+#endif
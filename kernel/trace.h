@@ -0,0 +1,55 @@
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+#include "util/types.h"
+
+// the tracepoints. *_BEGIN/*_END pairs become slices on the timeline, the others instants.
+enum trace_event_id {
+  TRACE_TRAP_BEGIN,      // a0: scause, a1: sepc
+  TRACE_TRAP_END,        // a0: pid of the process returned to
+  TRACE_SYSCALL_BEGIN,   // a0: syscall number, a1: first argument
+  TRACE_SYSCALL_END,     // a0: syscall number, a1: return value
+  TRACE_HTIF_BEGIN,      // a0: HTIF syscall number, a1: first argument
+  TRACE_HTIF_END,        // a0: HTIF syscall number, a1: return value
+  TRACE_ELF_LOAD_BEGIN,  // a0: entry
+  TRACE_ELF_LOAD_END,    // a0: status
+  TRACE_ELF_SEG_BEGIN,   // a0: vaddr, a1: memsz
+  TRACE_ELF_SEG_END,     // a0: vaddr, a1: filesz
+  TRACE_PAGE_FAULT,      // a0: faulting address, a1: scause
+  NR_TRACE_EVENTS
+};
+
+// one trace record, fixed size
+typedef struct trace_rec_t {
+  uint64 ts;      // cycle counter
+  uint16 event;   // enum trace_event_id
+  uint16 hart;
+  uint32 pid;     // pid of the current process, or -1 if there is none yet
+  uint64 a0, a1;  // event arguments
+} trace_rec;
+
+// records in the ring buffer of each hart. the ring is flushed to the host file when full.
+#define TRACE_RING_SIZE 4096
+
+// layout of the trace file: the header, then chunks of records, each chunk led by its
+// hart, its number of records and the number of records dropped right before it (three
+// uint64). tools/pke_trace.py converts it to Chrome trace (Perfetto) JSON.
+#define TRACE_MAGIC "PKETRAC1"
+typedef struct trace_header_t {
+  char magic[8];
+  uint64 rec_size;  // sizeof(trace_rec)
+  uint64 nharts;
+} trace_header;
+
+// tracepoints compile to nothing unless the kernel is built with -DPKE_TRACE (make TRACE=1)
+#ifdef PKE_TRACE
+#define TRACE(event, a0, a1) trace_event((event), (uint64)(a0), (uint64)(a1))
+#else
+#define TRACE(event, a0, a1) do {} while (0)
+#endif
+
+void trace_event(int event, uint64 a0, uint64 a1);
+int trace_start(const char *path);
+void trace_dump(void);
+
+#endif
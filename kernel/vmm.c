@@ -0,0 +1,240 @@
+/*
+ * virtual address mapping related functions.
+ */
+
+#include "vmm.h"
+#include "riscv.h"
+#include "pmm.h"
+#include "string.h"
+#include "util/functions.h"
+#include "spike_interface/spike_utils.h"
+#include "spike_interface/spike_initrd.h"
+
+/* --- utility functions for virtual address mapping --- */
+//
+// establish mapping of virtual address [va, va+size] to phyiscal address [pa, pa+size]
+// with the permission of "perm".
+//
+int map_pages(pagetable_t page_dir, uint64 va, uint64 size, uint64 pa, int perm) {
+  uint64 first, last;
+  pte_t *pte;
+
+  for (first = ROUNDDOWN(va, PGSIZE), last = ROUNDDOWN(va + size - 1, PGSIZE);
+      first <= last; first += PGSIZE, pa += PGSIZE) {
+    if ((pte = page_walk(page_dir, first, 1)) == 0) return -1;
+    if (*pte & PTE_V)
+      panic("map_pages fails on mapping va (0x%lx) to pa (0x%lx)", first, pa);
+    *pte = PA2PTE(pa) | perm | PTE_V;
+  }
+  return 0;
+}
+
+//
+// convert permission code to permission types of PTE
+//
+uint64 prot_to_type(int prot, int user) {
+  // risc-v reserves writable-but-not-readable pages, so PROT_WRITE implies PTE_R.
+  return (prot & (PROT_READ | PROT_WRITE) ? PTE_R : 0) | (prot & PROT_WRITE ? PTE_W : 0) |
+         (prot & PROT_EXEC ? PTE_X : 0) | (user ? PTE_U : 0) | PTE_A | PTE_D;
+}
+
+//
+// traverse the page table (starting from page_dir) to find the corresponding pte of va.
+// returns: PTE (page table entry) pointing to va.
+//
+pte_t *page_walk(pagetable_t page_dir, uint64 va, int alloc) {
+  if (va >= MAXVA) panic("page_walk");
+
+  // starting from the page directory
+  pagetable_t pt = page_dir;
+
+  // traverse from page directory to page table.
+  // as we use risc-v sv39 paging scheme, there will be 3 layers: page dir,
+  // page medium dir, and page table.
+  for (int level = 2; level > 0; level--) {
+    // macro "PX" gets the PTE index in page table of current level
+    // "pte" points to the entry of current level
+    pte_t *pte = pt + PX(level, va);
+
+    // now, we need to know if above pte is valid (established mapping to a phyiscal page)
+    // or not.
+    if (*pte & PTE_V) {  //PTE valid
+      // a leaf, i.e., a superpage: va has no pte of a (4KB) page.
+      if (*pte & (PTE_R | PTE_W | PTE_X)) return 0;
+      // phisical address of pagetable of next level
+      pt = (pagetable_t)PTE2PA(*pte);
+    } else { //PTE invalid (not exist).
+      // allocate a page (to be the new pagetable), if alloc == 1
+      if( alloc && ((pt = (pte_t *)alloc_zeroed_page()) != 0) ){
+        // writes the physical address of newly allocated page to pte, to establish the
+        // page table tree.
+        *pte = PA2PTE(pt) | PTE_V;
+      }else //returns NULL, if alloc == 0, or no more physical page remains
+        return 0;
+    }
+  }
+
+  // return a PTE which contains phisical address of a page
+  return pt + PX(0, va);
+}
+
+//
+// returns the level-1 leaf (i.e., the superpage of SUPERPAGE_SIZE bytes) that maps va, or
+// NULL if va is not mapped by a superpage.
+//
+pte_t *superpage_walk(pagetable_t page_dir, uint64 va) {
+  if (va >= MAXVA) return 0;
+  pte_t *pte = page_dir + PX(2, va);
+  if (!(*pte & PTE_V)) return 0;
+  pte = (pagetable_t)PTE2PA(*pte) + PX(1, va);
+  if ((*pte & PTE_V) && (*pte & (PTE_R | PTE_W | PTE_X))) return pte;
+  return 0;
+}
+
+//
+// look up a virtual page address, return the physical page address or 0 if not mapped.
+//
+uint64 lookup_pa(pagetable_t pagetable, uint64 va) {
+  pte_t *pte;
+  uint64 pa;
+
+  if (va >= MAXVA) return 0;
+
+  pte = page_walk(pagetable, va, 0);
+  if (pte == 0 || (*pte & PTE_V) == 0 || ((*pte & PTE_R) == 0 && (*pte & PTE_W) == 0))
+    return 0;
+  pa = PTE2PA(*pte);
+
+  return pa;
+}
+
+/* --- kernel page table part --- */
+// _etext is defined in kernel.lds, it points to the address after text and rodata segments.
+extern char _etext[];
+
+// pointer to kernel page director
+pagetable_t g_kernel_pagetable;
+
+//
+// maps virtual address [va, va+sz] to [pa, pa+sz] (for kernel).
+//
+void kern_vm_map(pagetable_t page_dir, uint64 va, uint64 pa, uint64 sz, int perm) {
+  if (map_pages(page_dir, va, sz, pa, perm) != 0) panic("kern_vm_map");
+}
+
+//
+// kern_vm_init() constructs the kernel page table.
+//
+void kern_vm_init(void) {
+  pagetable_t t_page_dir;
+
+  // allocate a page (t_page_dir) to be the page directory for kernel
+  t_page_dir = (pagetable_t)alloc_page();
+  memset(t_page_dir, 0, PGSIZE);
+
+  // map virtual address [KERN_BASE, _etext] to physical address [DRAM_BASE, DRAM_BASE+(_etext - KERN_BASE)],
+  // to maintain (direct) text section kernel address mapping.
+  kern_vm_map(t_page_dir, KERN_BASE, DRAM_BASE, (uint64)_etext - KERN_BASE,
+         prot_to_type(PROT_READ | PROT_EXEC, 0));
+
+  sprint("KERN_BASE 0x%lx\n", lookup_pa(t_page_dir, KERN_BASE));
+
+  // also (direct) map remaining address space, to make them accessable from kernel.
+  // here, we assume the size of physical memory used by our PKE is PKE_MAX_ALLOWABLE_RAM.
+  kern_vm_map(t_page_dir, (uint64)_etext, (uint64)_etext, PHYS_TOP - (uint64)_etext,
+         prot_to_type(PROT_READ | PROT_WRITE, 0));
+
+  // the initrd (if any) is loaded above PHYS_TOP, map it directly as well.
+  uint64 rd_start, rd_end;
+  if (initrd_range(&rd_start, &rd_end) == 0)
+    kern_vm_map(t_page_dir, rd_start, rd_start, rd_end - rd_start, prot_to_type(PROT_READ, 0));
+
+  sprint("physical address of _etext is: 0x%lx\n", lookup_pa(t_page_dir, (uint64)_etext));
+
+  g_kernel_pagetable = t_page_dir;
+}
+
+/* --- user page table part --- */
+//
+// convert and return the corresponding physical address of a virtual address (va) of
+// application.
+//
+void *user_va_to_pa(pagetable_t page_dir, void *va) {
+  uint64 pa = lookup_pa(page_dir, (uint64)va);
+  if (pa == 0) return NULL;
+  return (void *)(pa + ((uint64)va & (PGSIZE - 1)));
+}
+
+//
+// maps virtual address [va, va+sz] to [pa, pa+sz] (for user application).
+//
+void user_vm_map(pagetable_t page_dir, uint64 va, uint64 size, uint64 pa, int perm) {
+  if (map_pages(page_dir, va, size, pa, perm) != 0) {
+    panic("fail to user_vm_map .\n");
+  }
+}
+
+//
+// maps the superpage at va to the physically contiguous SUPERPAGE_SIZE bytes at pa (both
+// aligned to SUPERPAGE_SIZE), for user application.
+//
+void user_vm_map_superpage(pagetable_t page_dir, uint64 va, uint64 pa, int perm) {
+  pte_t *pte = page_dir + PX(2, va);
+  if (!(*pte & PTE_V)) {
+    pagetable_t pmd = (pagetable_t)alloc_zeroed_page();
+    if (!pmd) panic("fail to user_vm_map_superpage .\n");
+    *pte = PA2PTE(pmd) | PTE_V;
+  }
+  pte = (pagetable_t)PTE2PA(*pte) + PX(1, va);
+  if (*pte & PTE_V) panic("user_vm_map_superpage fails on mapping va (0x%lx)", va);
+  *pte = PA2PTE(pa) | perm | PTE_V;
+}
+
+//
+// unmap virtual address [va, va+size] from the user app.
+// reclaim the physical pages if free!=0
+//
+void user_vm_unmap(pagetable_t page_dir, uint64 va, uint64 size, int free) {
+  for (uint64 first = ROUNDDOWN(va, PGSIZE); first < va + size; first += PGSIZE) {
+    pte_t *pte = page_walk(page_dir, first, 0);
+    if (pte == 0 || (*pte & PTE_V) == 0) continue;
+    if (free) free_page((void *)PTE2PA(*pte));
+    *pte = 0;
+  }
+  flush_tlb();
+}
+
+//
+// call fn on each user page (i.e., valid with PTE_U) mapped by page_dir, in the ascending
+// order of addresses. superpages are skipped, they belong to shared memory segments (see
+// kernel/shm.c), which take care of their own mappings.
+//
+void user_vm_walk(pagetable_t page_dir, void (*fn)(uint64 va, pte_t *pte, void *arg), void *arg) {
+  for (uint64 i = 0; i < PGSIZE / sizeof(pte_t); i++) {
+    if (!(page_dir[i] & PTE_V)) continue;
+    pagetable_t pmd = (pagetable_t)PTE2PA(page_dir[i]);
+    for (uint64 j = 0; j < PGSIZE / sizeof(pte_t); j++) {
+      if (!(pmd[j] & PTE_V) || (pmd[j] & (PTE_R | PTE_W | PTE_X))) continue;
+      pagetable_t pt = (pagetable_t)PTE2PA(pmd[j]);
+      for (uint64 k = 0; k < PGSIZE / sizeof(pte_t); k++) {
+        if ((pt[k] & (PTE_V | PTE_U)) != (PTE_V | PTE_U)) continue;
+        fn((i << PXSHIFT(2)) | (j << PXSHIFT(1)) | (k << PXSHIFT(0)), &pt[k], arg);
+      }
+    }
+  }
+}
+
+//
+// free the pages of the page table page_dir itself (but not the pages it maps).
+//
+void free_pagetable(pagetable_t page_dir) {
+  for (uint64 i = 0; i < PGSIZE / sizeof(pte_t); i++) {
+    if (!(page_dir[i] & PTE_V)) continue;
+    pagetable_t pmd = (pagetable_t)PTE2PA(page_dir[i]);
+    for (uint64 j = 0; j < PGSIZE / sizeof(pte_t); j++)
+      if ((pmd[j] & PTE_V) && !(pmd[j] & (PTE_R | PTE_W | PTE_X)))
+        free_page((void *)PTE2PA(pmd[j]));
+    free_page(pmd);
+  }
+  free_page(page_dir);
+}
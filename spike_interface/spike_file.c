@@ -8,17 +8,34 @@
 
 #include "spike_file.h"
 #include "spike_htif.h"
+#include "spike_pcache.h"
+#include "spike_initrd.h"
 #include "atomic.h"
 #include "string.h"
 #include "util/functions.h"
 #include "spike_interface/spike_utils.h"
+#include "kernel/mmap.h"
 //#include "../kernel/config.h"
 
-#define MAX_FILES 128
-#define MAX_FDS 128
 static spike_file_t* spike_fds[MAX_FDS];
 spike_file_t spike_files[MAX_FILES] = {[0 ... MAX_FILES - 1] = {-1, 0}};
 
+// free lists (stacks of indices) of spike_files[] and spike_fds[], such that allocating a
+// file or a descriptor is O(1) instead of a scan over the whole table.
+static uint16 free_files[MAX_FILES];
+static int nfree_files;
+static uint16 free_fds[MAX_FDS];
+static int nfree_fds;
+static spinlock_t free_lock = SPINLOCK_INIT;
+
+// pool of write-back buffers. wbuf_owner[i] is the file buffering its writes in wbufs[i],
+// and free_wbufs is a stack of the unused ones.
+static char wbufs[SPIKE_NWBUFS][SPIKE_WBUF_SIZE];
+static spike_file_t* wbuf_owner[SPIKE_NWBUFS];
+static uint16 free_wbufs[SPIKE_NWBUFS];
+static int nfree_wbufs;
+static spinlock_t wbuf_lock = SPINLOCK_INIT;
+
 void copy_stat(struct stat* dest_va, struct frontend_stat* src) {
   struct stat* dest = (struct stat*)dest_va;
   dest->st_dev = src->dev;
@@ -37,6 +54,19 @@ void copy_stat(struct stat* dest_va, struct frontend_stat* src) {
 }
 
 int spike_file_stat(spike_file_t* f, struct stat* s) {
+  if (f->flags & SPIKE_FILE_INITRD) {
+    memset(s, 0, sizeof(*s));
+    s->st_ino = f->rd->ino;
+    s->st_mode = f->rd->mode;
+    s->st_nlink = 1;
+    s->st_size = f->rd->size;
+    s->st_blksize = 4096;
+    s->st_blocks = ROUNDUP(f->rd->size, 512) / 512;
+    s->st_mtime = f->rd->mtime;
+    return 0;
+  }
+
+  spike_file_flush(f);
   struct frontend_stat buf;
   uint64 pa = (uint64)&buf;
   long ret = frontend_syscall(HTIFSYS_fstat, f->kfd, (uint64)&buf, 0, 0, 0, 0, 0);
@@ -44,11 +74,25 @@ int spike_file_stat(spike_file_t* f, struct stat* s) {
   return ret;
 }
 
+// return a file structure (whose refcnt has dropped to 0) to the free list.
+static void spike_file_put_free(spike_file_t* f) {
+  spinlock_lock(&free_lock);
+  free_files[nfree_files++] = f - spike_files;
+  spinlock_unlock(&free_lock);
+}
+
 int spike_file_close(spike_file_t* f) {
   if (!f) return -1;
-  spike_file_t* old = atomic_cas(&spike_fds[f->kfd], f, 0);
+  spike_file_flush(f);
+  // release the descriptor slot, if f was published by spike_file_dup().
+  if (f->kfd >= 0 && f->kfd < MAX_FDS && atomic_cas(&spike_fds[f->kfd], f, 0) == f) {
+    spinlock_lock(&free_lock);
+    free_fds[nfree_fds++] = f->kfd;
+    spinlock_unlock(&free_lock);
+    spike_file_decref(f);
+  }
+  // drop the reference obtained from spike_file_openat().
   spike_file_decref(f);
-  if (old != f) return -1;
   spike_file_decref(f);
   return 0;
 }
@@ -59,7 +103,9 @@ void spike_file_decref(spike_file_t* f) {
     mb();
     atomic_set(&f->refcnt, 0);
 
-    frontend_syscall(HTIFSYS_close, kfd, 0, 0, 0, 0, 0, 0);
+    spike_file_flush(f);
+    if (kfd >= 0) frontend_syscall(HTIFSYS_close, kfd, 0, 0, 0, 0, 0, 0);
+    spike_file_put_free(f);
   }
 }
 
@@ -68,32 +114,143 @@ void spike_file_incref(spike_file_t* f) {
   kassert(prev > 0);
 }
 
+static ssize_t spike_file_write_host(spike_file_t* f, const void* buf, size_t size) {
+  ssize_t ret = frontend_syscall(HTIFSYS_write, f->kfd, (uint64)buf, size, 0, 0, 0, 0);
+  // cached copies of the file are stale now, and so are the pages shared by its read-only
+  // mappings. mmap_invalidate() is defined in kernel/mmap.c
+  if (f->flags & SPIKE_FILE_REGULAR) {
+    pcache_invalidate(f->dev, f->ino);
+    mmap_invalidate(f->dev, f->ino);
+  }
+  return ret;
+}
+
+//
+// write the bytes pending in the write-back buffer of f to the host, and give the buffer
+// back to the pool. returns 0 on success, or a negative value if the host write failed.
+//
+int spike_file_flush(spike_file_t* f) {
+  if (!f->wbuf) return 0;
+
+  ssize_t ret = 0;
+  uint32 done;
+  for (done = 0; done < f->wlen; done += ret) {
+    ret = spike_file_write_host(f, f->wbuf + done, f->wlen - done);
+    if (ret <= 0) break;
+  }
+  // a host write of 0 bytes makes no progress: the bytes left are lost, report it.
+  if (done < f->wlen && ret == 0) ret = -1;
+
+  int i = (f->wbuf - wbufs[0]) / SPIKE_WBUF_SIZE;
+  f->wbuf = NULL;
+  f->wlen = 0;
+  spinlock_lock(&wbuf_lock);
+  wbuf_owner[i] = NULL;
+  free_wbufs[nfree_wbufs++] = i;
+  spinlock_unlock(&wbuf_lock);
+
+  return ret < 0 ? ret : 0;
+}
+
+//
+// flush the write-back buffers of all files, e.g., before the system shuts down.
+//
+void spike_file_flush_all(void) {
+  for (int i = 0; i < SPIKE_NWBUFS; i++)
+    if (wbuf_owner[i]) spike_file_flush(wbuf_owner[i]);
+}
+
+//
+// flush the write-back buffers of the other opens of host file (dev, ino), so that reading
+// it through f sees what has been written.
+//
+static void spike_file_flush_ino(uint64 dev, uint64 ino) {
+  for (int i = 0; i < SPIKE_NWBUFS; i++) {
+    spike_file_t* owner = wbuf_owner[i];
+    if (owner && (owner->flags & SPIKE_FILE_REGULAR) && owner->dev == dev && owner->ino == ino)
+      spike_file_flush(owner);
+  }
+}
+
+//
+// small writes are merged in a write-back buffer, which goes to the host in one HTIF call
+// when it fills up, or when the file is flushed (fsync, close, shutdown) or read.
+//
 ssize_t spike_file_write(spike_file_t* f, const void* buf, size_t size) {
-  return frontend_syscall(HTIFSYS_write, f->kfd, (uint64)buf, size, 0, 0, 0, 0);
+  if (f->flags & SPIKE_FILE_INITRD) return -EBADF;
+  if (f->flags & SPIKE_FILE_WRITE_THROUGH) return spike_file_write_host(f, buf, size);
+
+  if (f->wlen + size > SPIKE_WBUF_SIZE) {
+    ssize_t ret = spike_file_flush(f);
+    if (ret < 0) return ret;
+  }
+  // large writes gain nothing from buffering.
+  if (size >= SPIKE_WBUF_SIZE) return spike_file_write_host(f, buf, size);
+
+  if (!f->wbuf) {
+    spinlock_lock(&wbuf_lock);
+    if (nfree_wbufs > 0) {
+      int i = free_wbufs[--nfree_wbufs];
+      wbuf_owner[i] = f;
+      f->wbuf = wbufs[i];
+    }
+    spinlock_unlock(&wbuf_lock);
+    // all buffers are taken, fall back to writing through.
+    if (!f->wbuf) return spike_file_write_host(f, buf, size);
+  }
+
+  memcpy(f->wbuf + f->wlen, buf, size);
+  f->wlen += size;
+  return size;
 }
 
 static spike_file_t* spike_file_get_free(void) {
-  for (spike_file_t* f = spike_files; f < spike_files + MAX_FILES; f++)
-    if (atomic_read(&f->refcnt) == 0 && atomic_cas(&f->refcnt, 0, INIT_FILE_REF) == 0)
-      return f;
-  return NULL;
+  spike_file_t* f = NULL;
+
+  spinlock_lock(&free_lock);
+  if (nfree_files > 0) f = spike_files + free_files[--nfree_files];
+  spinlock_unlock(&free_lock);
+
+  if (f) {
+    atomic_set(&f->refcnt, INIT_FILE_REF);
+    f->flags = 0;
+    f->off = 0;
+    f->ra_next = 0;
+    f->ra_pages = 0;
+    f->wbuf = NULL;
+    f->wlen = 0;
+    f->rd = NULL;
+    f->priv = NULL;
+  }
+  return f;
 }
 
 int spike_file_dup(spike_file_t* f) {
-  for (int i = 0; i < MAX_FDS; i++) {
-    if (atomic_cas(&spike_fds[i], 0, f) == 0) {
-      spike_file_incref(f);
-      return i;
-    }
-  }
-  return -1;
+  int fd = -1;
+
+  spinlock_lock(&free_lock);
+  if (nfree_fds > 0) fd = free_fds[--nfree_fds];
+  spinlock_unlock(&free_lock);
+
+  if (fd < 0) return -1;
+  atomic_set(&spike_fds[fd], f);
+  spike_file_incref(f);
+  return fd;
 }
 
 void spike_file_init(void) {
-  // create stdin, stdout, stderr and FDs 0-2
+  // fill the free lists in descending order, so that lower indices are handed out first.
+  for (int i = MAX_FILES - 1; i >= 0; i--) free_files[nfree_files++] = i;
+  for (int i = MAX_FDS - 1; i >= 0; i--) free_fds[nfree_fds++] = i;
+  for (int i = SPIKE_NWBUFS - 1; i >= 0; i--) free_wbufs[nfree_wbufs++] = i;
+  pcache_init();
+
+  // create stdin, stdout, stderr and FDs 0-2. console output is not buffered, so that it
+  // keeps its order with the messages of the kernel.
   for (int i = 0; i < 3; i++) {
     spike_file_t* f = spike_file_get_free();
     f->kfd = i;
+    f->flags |= SPIKE_FILE_WRITE_THROUGH;
     spike_file_dup(f);
   }
 }
@@ -102,13 +259,37 @@ spike_file_t* spike_file_openat(int dirfd, const char* fn, int flags, int mode)
   spike_file_t* f = spike_file_get_free();
   if (f == NULL) return ERR_PTR(-ENOMEM);
 
+  // files in the initrd are opened (read-only) without asking the host.
+  const initrd_entry* rd;
+  if (dirfd == AT_FDCWD && (flags & O_ACCMODE) == O_RDONLY && (rd = initrd_lookup(fn))) {
+    f->kfd = -1;
+    f->flags = SPIKE_FILE_INITRD;
+    f->rd = rd;
+    return f;
+  }
+
   size_t fn_size = strlen(fn) + 1;
   long ret = frontend_syscall(HTIFSYS_openat, dirfd, (uint64)fn, fn_size, flags, mode, 0, 0);
   if (ret >= 0) {
     f->kfd = ret;
+
+    // remember the identity of regular files, and let read-only ones use the page cache.
+    struct stat st;
+    if (spike_file_stat(f, &st) == 0 && S_ISREG(st.st_mode)) {
+      f->flags |= SPIKE_FILE_REGULAR;
+      f->dev = st.st_dev;
+      f->ino = st.st_ino;
+      if ((flags & O_ACCMODE) == O_RDONLY) {
+        f->flags |= SPIKE_FILE_CACHED;
+        spike_file_flush_ino(f->dev, f->ino);
+      }
+    }
+    if ((flags & O_SYNC) == O_SYNC) f->flags |= SPIKE_FILE_WRITE_THROUGH;
     return f;
   } else {
-    spike_file_decref(f);
+    // the host file was never opened, so there is nothing to close.
+    atomic_set(&f->refcnt, 0);
+    spike_file_put_free(f);
     return ERR_PTR(ret);
   }
 }
@@ -117,14 +298,98 @@ spike_file_t* spike_file_open(const char* fn, int flags, int mode) {
   return spike_file_openat(AT_FDCWD, fn, flags, mode);
 }
 
+//
+// get a file that the kernel serves by itself (e.g., an end of a pipe), which has no host
+// descriptor. flags tell its kind, and priv points to the object behind it.
+//
+spike_file_t* spike_file_alloc(uint32 flags, void* priv) {
+  spike_file_t* f = spike_file_get_free();
+  if (f == NULL) return ERR_PTR(-ENOMEM);
+
+  f->kfd = -1;
+  f->flags = flags;
+  f->priv = priv;
+  return f;
+}
+
+//
+// read from a file in the initrd, which is a plain copy from memory.
+//
+static ssize_t initrd_pread(spike_file_t* f, void* buf, size_t size, off_t offset) {
+  if (offset >= f->rd->size) return 0;
+  size = MIN(size, f->rd->size - offset);
+  memcpy(buf, f->rd->data + offset, size);
+  return size;
+}
+
 ssize_t spike_file_pread(spike_file_t* f, void* buf, size_t size, off_t offset) {
+  if (f->flags & SPIKE_FILE_INITRD) return initrd_pread(f, buf, size, offset);
+  if (f->flags & SPIKE_FILE_CACHED) return pcache_pread(f, buf, size, offset);
+  spike_file_flush(f);
+  return frontend_syscall(HTIFSYS_pread, f->kfd, (uint64)buf, size, offset, 0, 0, 0);
+}
+
+//
+// read from file f without going through the page cache, e.g., to fill a page that is
+// mapped by mmap() (and would otherwise be copied twice).
+//
+ssize_t spike_file_pread_direct(spike_file_t* f, void* buf, size_t size, off_t offset) {
+  if (f->flags & SPIKE_FILE_INITRD) return initrd_pread(f, buf, size, offset);
+  spike_file_flush(f);
   return frontend_syscall(HTIFSYS_pread, f->kfd, (uint64)buf, size, offset, 0, 0, 0);
 }
 
 ssize_t spike_file_read(spike_file_t* f, void* buf, size_t size) {
+  if (f->flags & SPIKE_FILE_INITRD) {
+    ssize_t ret = initrd_pread(f, buf, size, f->off);
+    f->off += ret;
+    return ret;
+  }
+  if (f->flags & SPIKE_FILE_CACHED) {
+    // the host file position is never moved for cached files, PKE keeps it in f->off.
+    ssize_t ret = pcache_pread(f, buf, size, f->off);
+    if (ret > 0) f->off += ret;
+    return ret;
+  }
+  spike_file_flush(f);
   return frontend_syscall(HTIFSYS_read, f->kfd, (uint64)buf, size, 0, 0, 0, 0);
 }
 
 ssize_t spike_file_lseek(spike_file_t* f, size_t ptr, int dir) {
+  if (f->flags & (SPIKE_FILE_CACHED | SPIKE_FILE_INITRD)) {
+    struct stat st;
+    switch (dir) {
+      case SEEK_SET:
+        f->off = ptr;
+        break;
+      case SEEK_CUR:
+        f->off += ptr;
+        break;
+      case SEEK_END:
+        if (spike_file_stat(f, &st) != 0) return -1;
+        f->off = st.st_size + ptr;
+        break;
+      default:
+        return -1;
+    }
+    return f->off;
+  }
+  spike_file_flush(f);
   return frontend_syscall(HTIFSYS_lseek, f->kfd, ptr, dir, 0, 0, 0, 0);
 }
+
+//
+// get the identity of file f, which stays the same across opens of the same file. only
+// regular host files and the files in the initrd have one. returns -1 for other files.
+//
+int spike_file_identity(spike_file_t* f, uint64* dev, uint64* ino) {
+  if (f->flags & SPIKE_FILE_INITRD) {
+    *dev = SPIKE_INITRD_DEV;
+    *ino = (uint64)f->rd;
+    return 0;
+  }
+  if (!(f->flags & SPIKE_FILE_REGULAR)) return -1;
+  *dev = f->dev;
+  *ino = f->ino;
+  return 0;
+}
@@ -9,13 +9,54 @@
 typedef struct file {
   int kfd;  // file descriptor of the host file
   uint32 refcnt;
+  uint32 flags;  // SPIKE_FILE_* flags below
+  // identity of the host file (valid with SPIKE_FILE_REGULAR), keys of the page cache
+  uint64 dev, ino;
+  // file position, maintained by PKE (rather than the host) for SPIKE_FILE_CACHED files
+  off_t off;
+  // read-ahead state: where the next sequential read should start, and the current window
+  off_t ra_next;
+  uint32 ra_pages;
+  // write-back buffer (NULL until the first buffered write), and the bytes pending in it
+  char* wbuf;
+  uint32 wlen;
+  // the file in the initrd, for SPIKE_FILE_INITRD files
+  const struct initrd_entry_t* rd;
+  // the kernel object behind the file, for files served by the kernel (e.g., SPIKE_FILE_PIPE)
+  void* priv;
 } spike_file_t;
 
+// the file is a regular host file, and dev/ino identify it
+#define SPIKE_FILE_REGULAR 0x1
+// the file is read-only, and reads are served through the page cache
+#define SPIKE_FILE_CACHED 0x2
+// writes go straight to the host, bypassing the write-back buffer
+#define SPIKE_FILE_WRITE_THROUGH 0x4
+// the file is served from the in-memory initrd, and has no host descriptor (kfd is -1)
+#define SPIKE_FILE_INITRD 0x8
+// the file is an end of a pipe (kernel/pipe.c), and has no host descriptor (kfd is -1)
+#define SPIKE_FILE_PIPE 0x10
+
+// write-back buffers are taken from a pool shared by all files
+#define SPIKE_WBUF_SIZE 4096
+#define SPIKE_NWBUFS 64
+
+// capacity of the (global) host file table, and of the descriptor table of spike_file_dup().
+#define MAX_FILES 4096
+#define MAX_FDS 4096
+
 extern spike_file_t spike_files[];
 
+// open flags, passed as is to the host (i.e., Linux values)
 #define O_RDONLY 00
 #define O_WRONLY 01
 #define O_RDWR 02
+#define O_ACCMODE 03
+#define O_CREAT 0100
+#define O_TRUNC 01000
+#define O_APPEND 02000
+#define O_SYNC 04010000
+#define EBADF 9   /* Bad file number */
 #define ENOMEM 12 /* Out of memory */
 
 #define stdin (spike_files + 0)
@@ -24,6 +65,9 @@ extern spike_file_t spike_files[];
 
 #define INIT_FILE_REF 3
 
+// device number reported by spike_file_identity() for the files in the initrd
+#define SPIKE_INITRD_DEV ((uint64)-1)
+
 struct frontend_stat {
   uint64 dev;
   uint64 ino;
@@ -49,16 +93,22 @@ struct frontend_stat {
 
 void copy_stat(struct stat* dest, struct frontend_stat* src);
 spike_file_t* spike_file_open(const char* fn, int flags, int mode);
+spike_file_t* spike_file_alloc(uint32 flags, void* priv);
 int spike_file_close(spike_file_t* f);
 spike_file_t* spike_file_openat(int dirfd, const char* fn, int flags, int mode);
 ssize_t spike_file_lseek(spike_file_t* f, size_t ptr, int dir);
 ssize_t spike_file_read(spike_file_t* f, void* buf, size_t size);
 ssize_t spike_file_pread(spike_file_t* f, void* buf, size_t n, off_t off);
 ssize_t spike_file_write(spike_file_t* f, const void* buf, size_t n);
+ssize_t spike_file_pread_direct(spike_file_t* f, void* buf, size_t n, off_t off);
+void spike_file_incref(spike_file_t* f);
 void spike_file_decref(spike_file_t* f);
 void spike_file_init(void);
 int spike_file_dup(spike_file_t* f);
 int spike_file_truncate(spike_file_t* f, off_t len);
 int spike_file_stat(spike_file_t* f, struct stat* s);
+int spike_file_flush(spike_file_t* f);
+void spike_file_flush_all(void);
+int spike_file_identity(spike_file_t* f, uint64* dev, uint64* ino);
 
 #endif
@@ -16,6 +16,7 @@
 #include "spike_interface/spike_utils.h"
 #include "dts_parse.h"
 #include "string.h"
+#include "kernel/pmm.h"
 
 uint64 htif;  //is Spike HTIF avaiable? initially 0 (false)
 
@@ -69,9 +70,15 @@ extern uint64_t __htif_base;
 #define TOHOST_OFFSET ((uint64)tohost - (uint64)__htif_base)
 #define FROMHOST_OFFSET ((uint64)fromhost - (uint64)__htif_base)
 
-volatile int htif_console_buf;
 static spinlock_t htif_lock = SPINLOCK_INIT;
 
+// console input. characters sent by the host are gathered in the ring, from where they are
+// read at head and written at tail (both free-running). console_reading tells whether a
+// read request is outstanding at the host, the host answers it once a character is typed.
+static char console_ring[HTIF_CONSOLE_RING_SIZE];
+static volatile uint32 console_head, console_tail;
+static volatile int console_reading;
+
 static void __check_fromhost(void) {
   uint64_t fh = fromhost;
   if (!fh) return;
@@ -81,7 +88,10 @@ static void __check_fromhost(void) {
   assert(FROMHOST_DEV(fh) == 1);
   switch (FROMHOST_CMD(fh)) {
     case 0:
-      htif_console_buf = 1 + (uint8_t)FROMHOST_DATA(fh);
+      // a character typed on the host console. it is dropped if the ring is full.
+      console_reading = 0;
+      if (console_tail - console_head < HTIF_CONSOLE_RING_SIZE)
+        console_ring[console_tail++ % HTIF_CONSOLE_RING_SIZE] = (uint8_t)FROMHOST_DATA(fh);
       break;
     case 1:
       break;
@@ -107,6 +117,10 @@ static void do_tohost_fromhost(uint64 dev, uint64 cmd, uint64 data) {
         break;
       }
       __check_fromhost();
+    } else {
+      // the host has not answered yet, make use of the wait. zero_page_ahead() is defined
+      // in kernel/pmm.c
+      zero_page_ahead();
     }
   }
   spinlock_unlock(&htif_lock);
@@ -132,27 +146,54 @@ void htif_console_putchar(uint8_t ch) {
 #endif
 }
 
-int htif_console_getchar(void) {
+//
+// gather the console input that the host has sent, and ask for more. called on every timer
+// tick, and whenever a reader of the console finds the ring empty.
+//
+void htif_console_poll(void) {
 #if __riscv_xlen == 32
   // HTIF devices are not supported on RV32
-  return -1;
+  return;
 #endif
 
   spinlock_lock(&htif_lock);
   __check_fromhost();
-  int ch = htif_console_buf;
-  if (ch >= 0) {
-    htif_console_buf = -1;
+  if (!console_reading && console_tail - console_head < HTIF_CONSOLE_RING_SIZE) {
+    console_reading = 1;
     __set_tohost(1, 0, 0);
   }
   spinlock_unlock(&htif_lock);
+}
 
-  return ch - 1;
+//
+// take at most n characters of console input from the ring. does not wait, returns the
+// number of characters taken (0 if none has arrived).
+//
+int htif_console_read(char* buf, int n) {
+  spinlock_lock(&htif_lock);
+  int cnt = 0;
+  for (; cnt < n && console_head != console_tail; cnt++)
+    buf[cnt] = console_ring[console_head++ % HTIF_CONSOLE_RING_SIZE];
+  spinlock_unlock(&htif_lock);
+  return cnt;
+}
+
+//
+// returns the number of characters of console input waiting in the ring.
+//
+int htif_console_avail(void) { return console_tail - console_head; }
+
+int htif_console_getchar(void) {
+  char ch;
+  htif_console_poll();
+  return htif_console_read(&ch, 1) == 1 ? (uint8_t)ch : -1;
 }
 
 void htif_poweroff(void) {
   while (1) {
     fromhost = 0;
     tohost = 1;
+    // stop the hart until the host has seen the request, rather than spin.
+    asm volatile("wfi");
   }
 }
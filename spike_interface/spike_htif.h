@@ -97,8 +97,14 @@ void query_htif(uint64 dtb);
 // Spike HTIF functionalities
 void htif_syscall(uint64);
 
+// capacity of the ring buffer gathering console input, a power of 2
+#define HTIF_CONSOLE_RING_SIZE 1024
+
 void htif_console_putchar(uint8_t);
 int htif_console_getchar();
+void htif_console_poll(void);
+int htif_console_read(char* buf, int n);
+int htif_console_avail(void);
 void htif_poweroff() __attribute__((noreturn));
 
 #endif
@@ -0,0 +1,175 @@
+/*
+ * in-memory initrd.
+ *
+ * the initrd is a cpio archive ("newc" format) on the host, which is loaded into the
+ * emulated memory with a single host read at boot. afterwards, opening, reading and
+ * stat'ing the files it contains are served from memory, without any HTIF round trip.
+ * paths are indexed by a hash table, so that looking up a file does not scan the archive.
+ */
+
+#include "spike_initrd.h"
+#include "spike_file.h"
+#include "spike_htif.h"
+#include "string.h"
+#include "util/functions.h"
+#include "spike_interface/spike_utils.h"
+
+#define CPIO_NEWC_MAGIC "070701"
+#define CPIO_TRAILER "TRAILER!!!"
+#define CPIO_HEADER_SIZE 110
+
+// header of a member of a "newc" cpio archive. all fields are 8 hex digits in ASCII.
+typedef struct cpio_newc_header_t {
+  char magic[6];
+  char ino[8];
+  char mode[8];
+  char uid[8];
+  char gid[8];
+  char nlink[8];
+  char mtime[8];
+  char filesize[8];
+  char devmajor[8];
+  char devminor[8];
+  char rdevmajor[8];
+  char rdevminor[8];
+  char namesize[8];
+  char check[8];
+} cpio_newc_header;
+
+static initrd_entry entries[INITRD_MAX_FILES];
+static int nentries;
+// where the archive is loaded, [image_start, image_end)
+static uint64 image_start, image_end;
+// path_index[h] is 1 + the index of the entry hashed to slot h, or 0 if the slot is empty.
+static uint16 path_index[INITRD_HASH_SIZE];
+
+static uint32 parse_hex8(const char* s) {
+  uint32 v = 0;
+  for (int i = 0; i < 8; i++) {
+    char c = s[i];
+    v <<= 4;
+    if (c >= '0' && c <= '9') v |= c - '0';
+    else if (c >= 'a' && c <= 'f') v |= c - 'a' + 10;
+    else if (c >= 'A' && c <= 'F') v |= c - 'A' + 10;
+  }
+  return v;
+}
+
+// archives made by "find . | cpio" name their members "./path", and apps may ask for "/path".
+static const char* skip_prefix(const char* path) {
+  while (1) {
+    if (path[0] == '/') path++;
+    else if (path[0] == '.' && path[1] == '/') path += 2;
+    else return path;
+  }
+}
+
+// FNV-1a hash of a path
+static uint32 hash_path(const char* path) {
+  uint32 h = 2166136261u;
+  while (*path) h = (h ^ (uint8)*path++) * 16777619u;
+  return h;
+}
+
+static void index_entry(int i) {
+  uint32 h = hash_path(entries[i].name) & (INITRD_HASH_SIZE - 1);
+  while (path_index[h]) h = (h + 1) & (INITRD_HASH_SIZE - 1);
+  path_index[h] = i + 1;
+}
+
+//
+// find the file path in the initrd. returns NULL if there is no initrd or no such file.
+//
+const initrd_entry* initrd_lookup(const char* path) {
+  if (nentries == 0) return NULL;
+
+  path = skip_prefix(path);
+  for (uint32 h = hash_path(path) & (INITRD_HASH_SIZE - 1); path_index[h];
+       h = (h + 1) & (INITRD_HASH_SIZE - 1)) {
+    const initrd_entry* e = &entries[path_index[h] - 1];
+    if (strcmp(e->name, path) == 0) return e;
+  }
+  return NULL;
+}
+
+//
+// index the regular files of the cpio archive at [base, base + size).
+//
+static long parse_cpio(const char* base, uint64 size) {
+  uint64 off = 0;
+
+  while (off + CPIO_HEADER_SIZE <= size) {
+    const cpio_newc_header* hdr = (const cpio_newc_header*)(base + off);
+    if (strncmp(hdr->magic, CPIO_NEWC_MAGIC, sizeof(hdr->magic)) != 0) return -1;
+
+    uint32 namesize = parse_hex8(hdr->namesize);
+    uint32 filesize = parse_hex8(hdr->filesize);
+    const char* name = base + off + CPIO_HEADER_SIZE;
+    // the name (NUL terminated) and the data are both padded to multiples of 4 bytes.
+    uint64 data_off = ROUNDUP(off + CPIO_HEADER_SIZE + namesize, 4);
+    if (data_off + filesize > size) return -1;
+    if (strcmp(name, CPIO_TRAILER) == 0) break;
+
+    uint32 mode = parse_hex8(hdr->mode);
+    if (S_ISREG(mode)) {
+      if (nentries == INITRD_MAX_FILES) return -1;
+      initrd_entry* e = &entries[nentries];
+      e->name = skip_prefix(name);
+      e->data = base + data_off;
+      e->size = filesize;
+      e->mode = mode;
+      e->ino = parse_hex8(hdr->ino);
+      e->mtime = parse_hex8(hdr->mtime);
+      index_entry(nentries++);
+    }
+
+    off = ROUNDUP(data_off + filesize, 4);
+  }
+
+  return nentries;
+}
+
+//
+// load the cpio archive at (host) path into the emulated memory, right below the address
+// top (and above bottom), and index its files. returns the address the archive is loaded
+// at, or a negative value on errors.
+//
+long initrd_load(const char* path, uint64 bottom, uint64 top) {
+  spike_file_t* f = spike_file_open(path, O_RDONLY, 0);
+  if (IS_ERR_VALUE(f)) return PTR_ERR(f);
+  // the archive is read exactly once, keeping a copy in the page cache would be a waste.
+  f->flags &= ~SPIKE_FILE_CACHED;
+
+  long ret = -1;
+  struct stat st;
+  if (spike_file_stat(f, &st) != 0) goto out;
+
+  uint64 size = st.st_size;
+  uint64 base = ROUNDDOWN(top - ROUNDUP(size, 4096), 4096);
+  if (size >= top - bottom || base < bottom) goto out;
+
+  // the one bulk read of the archive.
+  if (spike_file_pread(f, (void*)base, size, 0) != size) goto out;
+  if (parse_cpio((const char*)base, size) < 0) goto out;
+  ret = base;
+  image_start = base;
+  image_end = base + ROUNDUP(size, 4096);
+
+out:
+  if (ret < 0) {
+    nentries = 0;
+    memset(path_index, 0, sizeof(path_index));
+  }
+  spike_file_close(f);
+  return ret;
+}
+
+//
+// get the memory region occupied by the initrd. returns -1 if no initrd is loaded.
+//
+int initrd_range(uint64* start, uint64* end) {
+  if (nentries == 0) return -1;
+  *start = image_start;
+  *end = image_end;
+  return 0;
+}
@@ -0,0 +1,25 @@
+#ifndef _SPIKE_INITRD_H_
+#define _SPIKE_INITRD_H_
+
+#include "util/types.h"
+
+// the initrd is a cpio archive ("newc" format, e.g., made by "cpio -o -H newc"), loaded
+// from the host in one read at boot. files in it are then served from memory.
+#define INITRD_MAX_FILES 1024
+// number of slots of the (open addressing) hash index of paths, a power of 2
+#define INITRD_HASH_SIZE 2048
+
+typedef struct initrd_entry_t {
+  const char* name;  // path in the archive, without leading "./" or "/"
+  const char* data;  // contents of the file
+  uint64 size;
+  uint32 mode;
+  uint32 ino;
+  uint64 mtime;
+} initrd_entry;
+
+long initrd_load(const char* path, uint64 bottom, uint64 top);
+const initrd_entry* initrd_lookup(const char* path);
+int initrd_range(uint64* start, uint64* end);
+
+#endif
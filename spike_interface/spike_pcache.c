@@ -0,0 +1,253 @@
+/*
+ * page cache of host files.
+ *
+ * cached pages are keyed by the identity of the host file (dev and ino, obtained with
+ * spike_file_stat when the file is opened) and the index of the page in the file. a hash
+ * table indexes the pages, and a LRU list decides which page to evict once the memory
+ * budget (PCACHE_NPAGES) is used up.
+ *
+ * each open file also tracks whether it is read sequentially. if so, a miss brings in a
+ * read-ahead window of pages that doubles on every sequential miss (up to PCACHE_RA_MAX),
+ * so that small sequential reads cost about one host call per window. random reads reset
+ * the window, and only fetch what they ask for.
+ */
+
+#include "spike_pcache.h"
+#include "spike_htif.h"
+#include "atomic.h"
+#include "string.h"
+#include "util/functions.h"
+#include "spike_interface/spike_utils.h"
+
+typedef struct pcache_page_t {
+  uint64 dev, ino;  // identity of the host file
+  uint64 index;     // index of the page in the file
+  uint32 len;       // number of valid bytes, less than a page only at the end of the file
+  struct pcache_page_t* hnext;             // next page in the same hash bucket
+  struct pcache_page_t *prev, *next;       // LRU list, most recently used first
+} pcache_page;
+
+static char pcache_data[PCACHE_NPAGES][PCACHE_PAGE_SIZE]
+    __attribute__((aligned(PCACHE_PAGE_SIZE)));
+static pcache_page pcache_pages[PCACHE_NPAGES];
+static pcache_page* hash_table[PCACHE_HASH_SIZE];
+// sentinel of the LRU list: lru.next is the most recently used page, lru.prev the least.
+static pcache_page lru;
+// unused pages, linked by hnext
+static pcache_page* free_pages;
+// number of cached pages whose (dev, ino) falls in each slot, to make invalidation cheap
+static uint16 ino_filter[PCACHE_INO_FILTER];
+// bounce buffer used to fill short runs of missing pages with one host read
+static char stage[PCACHE_STAGE_PAGES * PCACHE_PAGE_SIZE] __attribute__((aligned(16)));
+
+static pcache_stats stats;
+static spinlock_t pcache_lock = SPINLOCK_INIT;
+
+#define page_data(p) (pcache_data[(p)-pcache_pages])
+
+static inline uint64 hash_ino(uint64 dev, uint64 ino) {
+  return (ino * 0x9E3779B97F4A7C15ULL) ^ (dev * 0xC2B2AE3D27D4EB4FULL);
+}
+
+static inline pcache_page** bucket_of(uint64 dev, uint64 ino, uint64 index) {
+  uint64 h = hash_ino(dev, ino) + index * 0x165667B19E3779F9ULL;
+  return &hash_table[(h >> 32) % PCACHE_HASH_SIZE];
+}
+
+static inline uint16* filter_of(uint64 dev, uint64 ino) {
+  return &ino_filter[(hash_ino(dev, ino) >> 40) % PCACHE_INO_FILTER];
+}
+
+void pcache_init(void) {
+  lru.prev = lru.next = &lru;
+  free_pages = NULL;
+  for (int i = PCACHE_NPAGES - 1; i >= 0; i--) {
+    pcache_pages[i].hnext = free_pages;
+    free_pages = &pcache_pages[i];
+  }
+}
+
+static void lru_unlink(pcache_page* p) {
+  p->prev->next = p->next;
+  p->next->prev = p->prev;
+}
+
+static void lru_push_front(pcache_page* p) {
+  p->next = lru.next;
+  p->prev = &lru;
+  lru.next->prev = p;
+  lru.next = p;
+}
+
+static pcache_page* lookup(uint64 dev, uint64 ino, uint64 index) {
+  for (pcache_page* p = *bucket_of(dev, ino, index); p; p = p->hnext)
+    if (p->index == index && p->ino == ino && p->dev == dev) return p;
+  return NULL;
+}
+
+// unlink a cached page from the hash table and the LRU list.
+static void remove_page(pcache_page* p) {
+  pcache_page** pp = bucket_of(p->dev, p->ino, p->index);
+  while (*pp != p) pp = &(*pp)->hnext;
+  *pp = p->hnext;
+  lru_unlink(p);
+  (*filter_of(p->dev, p->ino))--;
+}
+
+//
+// cache len bytes (at most one page) of src as page index of the host file (dev, ino).
+// takes a free page, or evicts the least recently used one.
+//
+static void insert_page(uint64 dev, uint64 ino, uint64 index, const char* src, uint32 len) {
+  pcache_page* p = free_pages;
+  if (p) {
+    free_pages = p->hnext;
+  } else {
+    p = lru.prev;
+    remove_page(p);
+    stats.evictions++;
+  }
+
+  p->dev = dev;
+  p->ino = ino;
+  p->index = index;
+  p->len = len;
+  memcpy(page_data(p), src, len);
+
+  pcache_page** b = bucket_of(dev, ino, index);
+  p->hnext = *b;
+  *b = p;
+  lru_push_front(p);
+  (*filter_of(dev, ino))++;
+}
+
+//
+// fill the run of missing pages that starts at the page containing pos, and copy the bytes
+// in [pos, end) that the run covers to dst. the run is extended to ra_pages pages when the
+// request is shorter. returns the number of bytes copied, 0 at the end of file, or a
+// negative value on host errors.
+//
+static ssize_t fill_pages(spike_file_t* f, char* dst, uint64 pos, uint64 end, uint32 ra_pages) {
+  uint64 first = pos / PCACHE_PAGE_SIZE, last = (end - 1) / PCACHE_PAGE_SIZE;
+  uint64 npages = 1;
+  while (first + npages <= last && !lookup(f->dev, f->ino, first + npages)) npages++;
+
+  if (npages <= PCACHE_STAGE_PAGES) {
+    // read ahead of the request, as long as the pages are not cached yet.
+    uint64 wanted = npages;
+    uint64 window = MIN(ra_pages, PCACHE_STAGE_PAGES);
+    if (first + npages > last)
+      while (npages < window && !lookup(f->dev, f->ino, first + npages)) npages++;
+
+    // short run: read the whole pages into the bounce buffer with one host call.
+    uint64 base = first * PCACHE_PAGE_SIZE;
+    ssize_t r = frontend_syscall(HTIFSYS_pread, f->kfd, (uint64)stage,
+                                 npages * PCACHE_PAGE_SIZE, base, 0, 0, 0);
+    if (r <= 0) return r;
+
+    if (r > wanted * PCACHE_PAGE_SIZE)
+      stats.readahead += ROUNDUP(r, PCACHE_PAGE_SIZE) / PCACHE_PAGE_SIZE - wanted;
+    for (uint64 i = 0; i * PCACHE_PAGE_SIZE < r; i++)
+      insert_page(f->dev, f->ino, first + i, stage + i * PCACHE_PAGE_SIZE,
+                  MIN(r - i * PCACHE_PAGE_SIZE, PCACHE_PAGE_SIZE));
+
+    if (base + r <= pos) return 0;
+    uint64 cnt = MIN(end - pos, base + r - pos);
+    memcpy(dst, stage + (pos - base), cnt);
+    return cnt;
+  }
+
+  // long run (e.g., a segment loaded by the elf loader): read straight into dst with one
+  // host call, and cache the pages that the read covers entirely.
+  uint64 want = MIN(end, (first + npages) * PCACHE_PAGE_SIZE) - pos;
+  ssize_t r = frontend_syscall(HTIFSYS_pread, f->kfd, (uint64)dst, want, pos, 0, 0, 0);
+  if (r <= 0) return r;
+
+  for (uint64 idx = ROUNDUP(pos, PCACHE_PAGE_SIZE) / PCACHE_PAGE_SIZE;
+       idx * PCACHE_PAGE_SIZE < pos + r; idx++) {
+    uint64 len = MIN(pos + r - idx * PCACHE_PAGE_SIZE, PCACHE_PAGE_SIZE);
+    // a partial page is complete only when the host reported the end of file.
+    if (len < PCACHE_PAGE_SIZE && r == want) break;
+    insert_page(f->dev, f->ino, idx, dst + (idx * PCACHE_PAGE_SIZE - pos), len);
+  }
+  return r;
+}
+
+//
+// read n bytes of host file f from offset off into buf, through the page cache.
+// returns the number of bytes read (less than n at the end of file).
+//
+ssize_t pcache_pread(spike_file_t* f, void* buf, size_t n, off_t off) {
+  char* dst = (char*)buf;
+  ssize_t done = 0;
+  int missed = 0;
+
+  spinlock_lock(&pcache_lock);
+  // a read is sequential if it starts right where the last one ended. its first miss may
+  // come later, at a page boundary inside the read.
+  int seq = (off == f->ra_next);
+  while (done < n) {
+    uint64 pos = off + done;
+    pcache_page* p = lookup(f->dev, f->ino, pos / PCACHE_PAGE_SIZE);
+
+    if (!p) {
+      stats.misses++;
+      // the first miss of a sequential read grows the read-ahead window, that of any other
+      // read (i.e., random access) closes it. later misses of the read keep the window.
+      if (!missed) {
+        if (seq)
+          f->ra_pages = f->ra_pages ? MIN(f->ra_pages * 2, PCACHE_RA_MAX) : PCACHE_RA_MIN;
+        else
+          f->ra_pages = 0;
+        missed = 1;
+      }
+
+      ssize_t r = fill_pages(f, dst + done, pos, off + n, f->ra_pages);
+      if (r <= 0) {
+        if (done == 0) done = r;
+        break;
+      }
+      done += r;
+      continue;
+    }
+
+    stats.hits++;
+    lru_unlink(p);
+    lru_push_front(p);
+
+    uint32 pgoff = pos % PCACHE_PAGE_SIZE;
+    if (pgoff >= p->len) break;
+    size_t cnt = MIN(n - done, p->len - pgoff);
+    memcpy(dst + done, page_data(p) + pgoff, cnt);
+    done += cnt;
+    // nothing follows a partial page, it is the last one of the file.
+    if (p->len < PCACHE_PAGE_SIZE) break;
+  }
+  if (done > 0) f->ra_next = off + done;
+  spinlock_unlock(&pcache_lock);
+
+  return done;
+}
+
+//
+// drop all cached pages of the host file (dev, ino), e.g., after it is written.
+//
+void pcache_invalidate(uint64 dev, uint64 ino) {
+  spinlock_lock(&pcache_lock);
+  uint16* filter = filter_of(dev, ino);
+  for (pcache_page *p = lru.next, *next; *filter && p != &lru; p = next) {
+    next = p->next;
+    if (p->dev == dev && p->ino == ino) {
+      remove_page(p);
+      p->hnext = free_pages;
+      free_pages = p;
+    }
+  }
+  spinlock_unlock(&pcache_lock);
+}
+
+void pcache_get_stats(pcache_stats* s) {
+  spinlock_lock(&pcache_lock);
+  *s = stats;
+  spinlock_unlock(&pcache_lock);
+}
@@ -0,0 +1,34 @@
+#ifndef _SPIKE_PCACHE_H_
+#define _SPIKE_PCACHE_H_
+
+#include "util/types.h"
+#include "spike_file.h"
+
+// the page cache keeps the contents of host files in PKE memory, so that reading the same
+// bytes again does not need another round trip to the host via HTIF.
+#define PCACHE_PAGE_SIZE 4096
+// memory budget of the page cache (in pages), 2MB by default
+#define PCACHE_NPAGES 512
+// number of buckets of the hash table indexing cached pages
+#define PCACHE_HASH_SIZE 1024
+// misses spanning up to PCACHE_STAGE_PAGES pages are filled with one page-aligned host read
+#define PCACHE_STAGE_PAGES 32
+// bounds of the read-ahead window (in pages) of sequentially read files
+#define PCACHE_RA_MIN 4
+#define PCACHE_RA_MAX PCACHE_STAGE_PAGES
+// size of the filter that tells whether any page of a host file is cached
+#define PCACHE_INO_FILTER 256
+
+typedef struct pcache_stats_t {
+  uint64 hits;       // page lookups served from memory
+  uint64 misses;     // page lookups that went to the host
+  uint64 evictions;  // pages dropped (least recently used first) to make room for others
+  uint64 readahead;  // pages fetched by read-ahead before they were asked for
+} pcache_stats;
+
+void pcache_init(void);
+ssize_t pcache_pread(spike_file_t* f, void* buf, size_t n, off_t off);
+void pcache_invalidate(uint64 dev, uint64 ino);
+void pcache_get_stats(pcache_stats* s);
+
+#endif
@@ -10,6 +10,7 @@
 #include "util/snprintf.h"
 #include "spike_utils.h"
 #include "spike_file.h"
+#include "kernel/trace.h"
 
 //=============    encapsulating htif syscalls, invoking Spike functions    =============
 long frontend_syscall(long n, uint64 a0, uint64 a1, uint64 a2, uint64 a3, uint64 a4,
@@ -17,6 +18,7 @@ long frontend_syscall(long n, uint64 a0, uint64 a1, uint64 a2, uint64 a3, uint64
   static volatile uint64 magic_mem[8];
 
   static spinlock_t lock = SPINLOCK_INIT;
+  TRACE(TRACE_HTIF_BEGIN, n, a0);
   spinlock_lock(&lock);
 
   magic_mem[0] = n;
@@ -33,6 +35,7 @@ long frontend_syscall(long n, uint64 a0, uint64 a1, uint64 a2, uint64 a3, uint64
   long ret = magic_mem[0];
 
   spinlock_unlock(&lock);
+  TRACE(TRACE_HTIF_END, n, ret);
   return ret;
 }
 
@@ -83,6 +86,7 @@ void sprint(const char* s, ...) {
 void poweroff(uint16_t code) {
   assert(htif);
   sprint("Power off\r\n");
+  spike_file_flush_all();
   if (htif) {
     htif_poweroff();
   } else {
@@ -96,9 +100,13 @@ void poweroff(uint16_t code) {
 
 void shutdown(int code) {
   sprint("System is shutting down with exit code %d.\n", code);
+  // buffered writes must reach the host files before the emulator exits.
+  spike_file_flush_all();
   frontend_syscall(HTIFSYS_exit, code, 0, 0, 0, 0, 0, 0);
-  while (1)
-    ;
+  // the emulator is gone by now. if not, stop the hart rather than spin.
+  while (1) {
+    asm volatile("wfi\n");
+  }
 }
 
 void do_panic(const char* s, ...) {
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""
+Symbolise the samples written by the PKE profiler (spike obj/riscv-pke --profile=FILE ...)
+and print a flat profile. Optionally write a folded-stack profile, the input format of
+flamegraph.pl (https://github.com/brendangregg/FlameGraph).
+
+  python3 tools/pke_prof.py obj/profile.bin --kernel obj/riscv-pke --app obj/app_helloworld
+  python3 tools/pke_prof.py obj/profile.bin --kernel obj/riscv-pke --app 0=obj/app_a \\
+      --app 1=obj/app_b --folded obj/profile.folded
+
+Samples of user mode are symbolised against the app of their process (--app PID=ELF), or
+against the only app given without a pid. The pcs of a PIE app are moved back by the load
+bias the kernel recorded for its pid, so that they match the link addresses of the ELF.
+
+Each sample carries the return addresses of up to PROF_DEPTH callers, found by walking the
+frame pointers, which make the stacks of the folded profile (outermost caller first).
+"""
+
+import argparse
+import bisect
+import collections
+import struct
+import sys
+
+MODES = {0: "user", 1: "kernel", 3: "machine"}
+
+
+class Symbols:
+    """function symbols of an ELF64 file, looked up by address."""
+
+    def __init__(self, path):
+        self.name = path.rsplit("/", 1)[-1]
+        self.starts, self.ends, self.names = [], [], []
+        with open(path, "rb") as f:
+            data = f.read()
+        if data[:4] != b"\x7fELF" or data[4] != 2:
+            raise SystemExit("%s: not an ELF64 file" % path)
+
+        shoff, = struct.unpack_from("<Q", data, 0x28)
+        shentsize, shnum = struct.unpack_from("<HH", data, 0x3A)
+        sections = [struct.unpack_from("<IIQQQQIIQQ", data, shoff + i * shentsize)
+                    for i in range(shnum)]
+        syms = []
+        for sh in sections:
+            if sh[1] != 2:  # SHT_SYMTAB
+                continue
+            strtab = sections[sh[6]]
+            for off in range(sh[4], sh[4] + sh[5], sh[9]):
+                name, info, _, _, value, size = struct.unpack_from("<IBBHQQ", data, off)
+                if info & 0xF != 2:  # STT_FUNC
+                    continue
+                end = data.index(b"\0", strtab[4] + name)
+                syms.append((value, value + max(size, 1),
+                             data[strtab[4] + name:end].decode(errors="replace")))
+        for start, end, name in sorted(syms):
+            self.starts.append(start)
+            self.ends.append(end)
+            self.names.append(name)
+
+    def lookup(self, pc):
+        i = bisect.bisect_right(self.starts, pc) - 1
+        if i >= 0 and pc < self.ends[i]:
+            return self.names[i]
+        return "0x%x" % pc
+
+
+def read_samples(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, interval, nharts = struct.unpack_from("<8sQQ", data, 0)
+    # profiles of older kernels have no load biases (PKEPROF1) and no callers (PKEPROF2).
+    if magic not in (b"PKEPROF1", b"PKEPROF2", b"PKEPROF3"):
+        raise SystemExit("%s: not a PKE profile" % path)
+    off, biases, depth = 24, {}, 0
+    if magic != b"PKEPROF1":
+        nprocs, = struct.unpack_from("<Q", data, off)
+        off += 8
+        if magic == b"PKEPROF3":
+            depth, = struct.unpack_from("<Q", data, off)
+            off += 8
+        biases = dict(enumerate(struct.unpack_from("<%dQ" % nprocs, data, off)))
+        off += 8 * nprocs
+    samples, dropped = [], 0
+    for hart in range(nharts):
+        n, d = struct.unpack_from("<QQ", data, off)
+        off += 16
+        for _ in range(n):
+            pc, pid, mode = struct.unpack_from("<QII", data, off)
+            frames = struct.unpack_from("<%dQ" % depth, data, off + 16)
+            off += 16 + 8 * depth
+            samples.append((hart, pc, pid, mode, [ra for ra in frames if ra]))
+        dropped += d
+    return interval, biases, samples, dropped
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    ap.add_argument("profile", help="file written by --profile=")
+    ap.add_argument("--kernel", help="ELF of the PKE kernel (obj/riscv-pke)")
+    ap.add_argument("--app", action="append", default=[],
+                    help="ELF of a user app, as PID=ELF, or ELF for all processes")
+    ap.add_argument("--folded", help="write folded stacks (for flamegraph.pl) to this file")
+    ap.add_argument("--top", type=int, default=40, help="rows of the flat profile")
+    args = ap.parse_args()
+
+    kernel = Symbols(args.kernel) if args.kernel else None
+    apps, default_app = {}, None
+    for a in args.app:
+        if "=" in a:
+            pid, path = a.split("=", 1)
+            apps[int(pid)] = Symbols(path)
+        else:
+            default_app = Symbols(a)
+
+    interval, biases, samples, dropped = read_samples(args.profile)
+    flat = collections.Counter()
+    folded = collections.Counter()
+    for hart, pc, pid, mode, frames in samples:
+        bias = 0
+        if mode == 0:
+            syms = apps.get(pid, default_app)
+            bias = biases.get(pid, 0)
+        else:
+            syms = kernel
+
+        def name(addr):
+            return syms.lookup(addr - bias) if syms else "0x%x" % (addr - bias)
+
+        func = name(pc)
+        where = syms.name if (syms and mode == 0) else MODES.get(mode, "mode%d" % mode)
+        flat[(where, func)] += 1
+        proc = "pid %d" % pid if pid != 0xFFFFFFFF else "boot"
+        # a return address follows the call, look up the call itself (ra - 4).
+        callers = [name(ra - 4) for ra in reversed(frames)]
+        folded[";".join([proc, MODES.get(mode, "mode%d" % mode)] + callers + [func])] += 1
+
+    total = len(samples)
+    print("%d samples (every %d mtime units), %d dropped" % (total, interval, dropped))
+    print("%8s %7s  %-12s %s" % ("samples", "%", "where", "function"))
+    for (where, func), n in flat.most_common(args.top):
+        print("%8d %6.2f%%  %-12s %s" % (n, 100.0 * n / max(total, 1), where, func))
+
+    if args.folded:
+        with open(args.folded, "w") as f:
+            for stack, n in sorted(folded.items()):
+                f.write("%s %d\n" % (stack, n))
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""
+Convert the records of the PKE tracer (kernel built with make TRACE=1, run as
+spike obj/riscv-pke --trace=FILE ...) to Chrome trace JSON, which chrome://tracing and
+ui.perfetto.dev open as a timeline.
+
+  python3 tools/pke_trace.py obj/trace.bin -o obj/trace.json
+
+Traps, syscalls, HTIF calls and ELF loads become nested slices on the track of their hart,
+page faults become instants. Timestamps are cycles, scaled by --mhz.
+"""
+
+import argparse
+import json
+import struct
+import sys
+
+# enum trace_event_id of kernel/trace.h: (name, phase) where phase is B(egin), E(nd) or
+# I(nstant). B and E records of the same name open and close one slice.
+EVENTS = [
+    ("trap", "B"), ("trap", "E"),
+    ("syscall", "B"), ("syscall", "E"),
+    ("htif", "B"), ("htif", "E"),
+    ("elf_load", "B"), ("elf_load", "E"),
+    ("elf_segment", "B"), ("elf_segment", "E"),
+    ("page_fault", "I"),
+]
+
+# kernel/syscall.h
+SYSCALLS = ["print", "exit", "open", "read", "write", "pread", "close", "lseek", "fstat",
+            "pcache_stat", "fsync", "mmap", "munmap", "print_ring", "print_flush", "perf"]
+SYS_USER_BASE = 64
+
+# HTIF syscall numbers (spike_interface/spike_htif.h), as used by the kernel
+HTIF_CALLS = {17: "getcwd", 25: "fcntl", 48: "faccessat", 56: "openat", 57: "close",
+              62: "lseek", 63: "read", 64: "write", 67: "pread", 68: "pwrite", 79: "fstatat",
+              80: "fstat", 81: "init_memsize", 46: "ftruncate", 93: "exit", 222: "mmap",
+              1024: "open", 2011: "getmainvars"}
+
+SCAUSES = {8: "ecall", 12: "fetch page fault", 13: "load page fault",
+           15: "store page fault", (1 << 63) | 1: "timer tick"}
+
+
+def slice_name(kind, a0, a1):
+    if kind == "trap":
+        return "trap: " + SCAUSES.get(a0, "scause 0x%x" % a0)
+    if kind == "syscall":
+        i = a0 - SYS_USER_BASE
+        return "sys_" + (SYSCALLS[i] if 0 <= i < len(SYSCALLS) else str(a0))
+    if kind == "htif":
+        return "htif: " + HTIF_CALLS.get(a0, str(a0))
+    return kind
+
+
+def read_records(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, rec_size, nharts = struct.unpack_from("<8sQQ", data, 0)
+    if magic != b"PKETRAC1":
+        raise SystemExit("%s: not a PKE trace" % path)
+    off, recs, dropped = 24, [], 0
+    while off + 24 <= len(data):
+        hart, n, d = struct.unpack_from("<QQQ", data, off)
+        off += 24
+        for _ in range(n):
+            recs.append(struct.unpack_from("<QHHIQQ", data, off))
+            off += rec_size
+        dropped += d
+    return recs, dropped
+
+
+def convert(recs, mhz):
+    out = []
+    t0 = recs[0][0] if recs else 0
+    stacks = {}  # hart -> open slices, as [kind, ...]
+
+    def us(ts):
+        return (ts - t0) / mhz
+
+    for ts, event, hart, pid, a0, a1 in recs:
+        if event >= len(EVENTS):
+            continue
+        kind, ph = EVENTS[event]
+        pid = -1 if pid == 0xFFFFFFFF else pid
+        base = {"pid": 0, "tid": hart, "ts": us(ts), "cat": kind}
+        stack = stacks.setdefault(hart, [])
+        if ph == "B":
+            stack.append(kind)
+            out.append(dict(base, ph="B", name=slice_name(kind, a0, a1),
+                            args={"pid": pid, "a0": hex(a0), "a1": hex(a1)}))
+        elif ph == "E":
+            # slices left open by paths that do not return (e.g., a syscall that blocks the
+            # process) are closed along with the enclosing one.
+            if kind not in stack:
+                continue
+            while stack:
+                top = stack.pop()
+                out.append(dict(base, ph="E", cat=top,
+                                args={"a0": hex(a0), "a1": hex(a1)} if top == kind else {}))
+                if top == kind:
+                    break
+        else:
+            out.append(dict(base, ph="i", s="t", name=kind,
+                            args={"pid": pid, "a0": hex(a0), "a1": hex(a1)}))
+
+    end = us(recs[-1][0]) if recs else 0
+    for hart, stack in stacks.items():
+        for kind in reversed(stack):
+            out.append({"pid": 0, "tid": hart, "ts": end, "ph": "E", "cat": kind})
+        out.append({"pid": 0, "tid": hart, "ph": "M", "name": "thread_name",
+                    "args": {"name": "hart %d" % hart}})
+    out.append({"pid": 0, "ph": "M", "name": "process_name", "args": {"name": "PKE"}})
+    return out
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__.split("\n\n")[0])
+    ap.add_argument("trace", help="file written by --trace=")
+    ap.add_argument("-o", "--output", default="-", help="JSON output file (default stdout)")
+    ap.add_argument("--mhz", type=float, default=1000.0,
+                    help="cycles per microsecond of the timestamps (default 1000)")
+    args = ap.parse_args()
+
+    recs, dropped = read_records(args.trace)
+    events = convert(recs, args.mhz)
+    doc = {"traceEvents": events, "displayTimeUnit": "ns",
+           "otherData": {"records": len(recs), "dropped": dropped}}
+    if args.output == "-":
+        json.dump(doc, sys.stdout)
+    else:
+        with open(args.output, "w") as f:
+            json.dump(doc, f)
+    print("%d records (%d dropped)" % (len(recs), dropped), file=sys.stderr)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
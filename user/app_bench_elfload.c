@@ -0,0 +1,27 @@
+/*
+ * A synthetic large binary, to benchmark loading ELF files: its .data segment is
+ * BLOB_SIZE bytes, all of which the kernel reads from the host at load time. the load time
+ * is in the boot_timing line that the kernel prints before the app starts (the elf_open,
+ * elf_header and elf_segments phases).
+ *
+ * Run it by command:
+ * $ make obj/app_bench_elfload
+ * $ spike ./obj/riscv-pke ./obj/app_bench_elfload
+ */
+
+#include "user_lib.h"
+#include "util/types.h"
+
+#define BLOB_SIZE (2 * 1024 * 1024)
+
+// initialized (non-zero) data is stored in the file, unlike bss.
+static char blob[BLOB_SIZE] = {1};
+
+int main(void) {
+  // check that the segment is loaded, and keep the blob from being optimized away.
+  uint64 sum = 0;
+  for (int i = 0; i < BLOB_SIZE; i += 4096) sum += blob[i];
+  printu("bench_elfload: data_bytes=%d loaded=%s\n", BLOB_SIZE, sum == 1 ? "yes" : "no");
+
+  exit(0);
+}
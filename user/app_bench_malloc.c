@@ -0,0 +1,47 @@
+/*
+ * Benchmark of the allocator of the user library: the cost of malloc/free pairs of small
+ * blocks (of mixed sizes), and of large blocks, with the number of sbrk() calls they made.
+ *
+ * Run it by command:
+ * $ make obj/app_bench_malloc
+ * $ spike ./obj/riscv-pke ./obj/app_bench_malloc
+ */
+
+#include "user_lib.h"
+#include "util/types.h"
+
+#define NLIVE 256
+#define NROUNDS 40
+#define NLARGE 200
+
+static void *live[NLIVE];
+
+int main(void) {
+  malloc_stats st;
+
+  // keep NLIVE blocks alive, and replace each of them NROUNDS times.
+  uint64 start = rdcycle();
+  for (int r = 0; r < NROUNDS; r++) {
+    for (int i = 0; i < NLIVE; i++) {
+      free(live[i]);
+      live[i] = malloc(8 + (i * 37 + r * 11) % 1024);
+    }
+  }
+  uint64 cycles = rdcycle() - start;
+  malloc_get_stats(&st);
+  printu("bench_malloc small: ops=%d cycles_per_op=%ld sbrk_calls=%ld arena=%ld\n",
+         NLIVE * NROUNDS, cycles / (NLIVE * NROUNDS), st.nsbrk, st.arena);
+
+  start = rdcycle();
+  for (int i = 0; i < NLARGE; i++) {
+    char *p = malloc(100 * 1024);
+    p[0] = 1;
+    free(p);
+  }
+  cycles = rdcycle() - start;
+  malloc_get_stats(&st);
+  printu("bench_malloc large: ops=%d cycles_per_op=%ld sbrk_calls=%ld in_use=%ld\n", NLARGE,
+         cycles / NLARGE, st.nsbrk, st.in_use);
+
+  exit(0);
+}
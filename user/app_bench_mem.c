@@ -0,0 +1,41 @@
+/*
+ * Benchmark of the memcpy/memset bandwidth (of util/string.c) in user mode, over buffers of
+ * several sizes.
+ *
+ * Run it by command:
+ * $ make obj/app_bench_mem
+ * $ spike ./obj/riscv-pke ./obj/app_bench_mem
+ */
+
+#include "user_lib.h"
+#include "util/types.h"
+#include "util/string.h"
+
+#define MAX_SIZE (256 * 1024)
+// bytes moved for each buffer size
+#define TOTAL_BYTES (4 * 1024 * 1024)
+
+static char src[MAX_SIZE], dst[MAX_SIZE];
+
+static void report(const char *op, uint64 size, uint64 cycles) {
+  printu("bench_mem %s: size=%ld bytes=%d cycles=%ld bytes_per_kcycle=%ld\n", op, size,
+         TOTAL_BYTES, cycles, (uint64)TOTAL_BYTES * 1000 / cycles);
+}
+
+int main(void) {
+  // touch the buffers first, so that the runs below see no first-touch effects.
+  memset(src, 1, MAX_SIZE);
+  memset(dst, 0, MAX_SIZE);
+
+  for (uint64 size = 64; size <= MAX_SIZE; size *= 16) {
+    uint64 start = rdcycle();
+    for (uint64 done = 0; done < TOTAL_BYTES; done += size) memcpy(dst, src, size);
+    report("memcpy", size, rdcycle() - start);
+
+    start = rdcycle();
+    for (uint64 done = 0; done < TOTAL_BYTES; done += size) memset(dst, (int)done, size);
+    report("memset", size, rdcycle() - start);
+  }
+
+  exit(0);
+}
@@ -0,0 +1,87 @@
+/*
+ * Benchmark of pipes between two processes: the round trip of a byte between a parent and
+ * its child (i.e., two context switches and two pipe transfers), and the throughput of a
+ * pipe, with copying writes and with page-moving writes (vmsplice_u).
+ *
+ * Run it by command:
+ * $ make obj/app_bench_pipe
+ * $ spike ./obj/riscv-pke ./obj/app_bench_pipe
+ */
+
+#include "user_lib.h"
+#include "util/types.h"
+
+#define NROUNDS 1000
+#define CHUNK (64 * 1024)
+#define TOTAL (16 * 1024 * 1024)
+
+static char buf[CHUNK] __attribute__((aligned(4096)));
+
+// write all of [p, p + n) to fd, whatever the pipe takes at a time.
+static int write_all(int fd, char *p, uint64 n, int move) {
+  while (n > 0) {
+    int r = move ? vmsplice_u(fd, p, n) : write_u(fd, p, n);
+    if (r <= 0) return -1;
+    p += r;
+    n -= r;
+  }
+  return 0;
+}
+
+static void bench_pingpong(void) {
+  int ping[2], pong[2];
+  if (pipe_u(ping) != 0 || pipe_u(pong) != 0) return;
+
+  char c = 0;
+  int pid = fork();
+  if (pid == 0) {
+    close(ping[1]);
+    close(pong[0]);
+    while (read_u(ping[0], &c, 1) == 1) write_u(pong[1], &c, 1);
+    exit(0);
+  }
+  close(ping[0]);
+  close(pong[1]);
+
+  uint64 start = rdcycle();
+  for (int i = 0; i < NROUNDS; i++) {
+    write_u(ping[1], &c, 1);
+    read_u(pong[0], &c, 1);
+  }
+  uint64 cycles = rdcycle() - start;
+
+  close(ping[1]);
+  wait_u(pid, NULL);
+  close(pong[0]);
+  printu("bench_pipe pingpong: rounds=%d cycles_per_round=%ld\n", NROUNDS, cycles / NROUNDS);
+}
+
+static void bench_stream(int move) {
+  int fds[2];
+  if (pipe_u(fds) != 0) return;
+
+  int pid = fork();
+  if (pid == 0) {
+    close(fds[1]);
+    while (read_u(fds[0], buf, CHUNK) > 0) {}
+    exit(0);
+  }
+  close(fds[0]);
+
+  uint64 start = rdcycle();
+  for (uint64 done = 0; done < TOTAL; done += CHUNK)
+    if (write_all(fds[1], buf, CHUNK, move) != 0) break;
+  close(fds[1]);
+  wait_u(pid, NULL);
+  uint64 cycles = rdcycle() - start;
+
+  printu("bench_pipe %s: bytes=%d cycles=%ld bytes_per_kcycle=%ld\n",
+         move ? "vmsplice" : "write", TOTAL, cycles, (uint64)TOTAL * 1000 / cycles);
+}
+
+int main(void) {
+  bench_pingpong();
+  bench_stream(0);
+  bench_stream(1);
+  exit(0);
+}
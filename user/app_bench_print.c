@@ -0,0 +1,40 @@
+/*
+ * Benchmark of the console output throughput of printu(), with a syscall per call, and
+ * through the console output ring shared with the kernel.
+ *
+ * Run it by command:
+ * $ make obj/app_bench_print
+ * $ spike ./obj/riscv-pke ./obj/app_bench_print
+ */
+
+#include "user_lib.h"
+#include "util/types.h"
+
+#define NLINES 256
+// 63 characters and the newline
+#define LINE "...............................................................\n"
+
+//
+// print NLINES lines of 64 bytes, returns the number of cycles taken.
+//
+static uint64 bench(void) {
+  uint64 start = rdcycle();
+  for (int i = 0; i < NLINES; i++) printu(LINE);
+  return rdcycle() - start;
+}
+
+static void report(const char *name, uint64 cycles) {
+  printu("bench_print %s: lines=%d size=%d cycles=%ld bytes_per_kcycle=%ld\n", name, NLINES,
+         64, cycles, (uint64)NLINES * 64 * 1000 / cycles);
+}
+
+int main(void) {
+  uint64 syscall_cycles = bench();
+  // from here on, printu() goes through the ring.
+  uint64 ring_cycles = print_ring_u() == 0 ? bench() : 0;
+
+  report("syscall", syscall_cycles);
+  if (ring_cycles) report("ring", ring_cycles);
+
+  exit(0);
+}
@@ -0,0 +1,84 @@
+/*
+ * Benchmark of reading a host file: sequential reads of several sizes, and random preads,
+ * each over a cold and then a warm kernel page cache.
+ *
+ * Run it by command:
+ * $ make obj/app_bench_read
+ * $ spike ./obj/riscv-pke ./obj/app_bench_read
+ */
+
+#include "user_lib.h"
+#include "util/types.h"
+
+#define BENCH_FILE "/tmp/pke_bench_read.tmp"
+#define FILE_SIZE (256 * 1024)
+
+static char buf[64 * 1024];
+
+// report a run, with the page cache hits and misses it made (the counters are cumulative
+// since boot, before holds them as of the start of the run).
+static void report(const char *name, uint64 chunk, uint64 bytes, uint64 cycles,
+                   const pcache_stats *before) {
+  pcache_stats st;
+  pcache_stat_u(&st);
+  printu("bench_read %s: chunk=%ld bytes=%ld cycles=%ld bytes_per_kcycle=%ld hits=%ld "
+         "misses=%ld\n", name, chunk, bytes, cycles, bytes * 1000 / cycles,
+         st.hits - before->hits, st.misses - before->misses);
+}
+
+//
+// read the whole file sequentially, chunk bytes at a time.
+//
+static void bench_sequential(const char *name, uint64 chunk) {
+  int fd = open(BENCH_FILE, O_RDONLY, 0);
+  if (fd < 0) {
+    printu("cannot open %s\n", BENCH_FILE);
+    return;
+  }
+  pcache_stats before;
+  pcache_stat_u(&before);
+  uint64 bytes = 0, start = rdcycle();
+  int n;
+  while ((n = read_u(fd, buf, chunk)) > 0) bytes += n;
+  uint64 cycles = rdcycle() - start;
+  close(fd);
+  report(name, chunk, bytes, cycles, &before);
+}
+
+//
+// read 4KB blocks of the file in a scattered order.
+//
+static void bench_random(const char *name) {
+  int fd = open(BENCH_FILE, O_RDONLY, 0);
+  if (fd < 0) {
+    printu("cannot open %s\n", BENCH_FILE);
+    return;
+  }
+  pcache_stats before;
+  pcache_stat_u(&before);
+  uint64 nblocks = FILE_SIZE / 4096, bytes = 0, start = rdcycle();
+  // 7 is coprime to the number of blocks, so each block is read once.
+  for (uint64 i = 0; i < nblocks; i++) bytes += pread_u(fd, buf, 4096, (i * 7 % nblocks) * 4096);
+  uint64 cycles = rdcycle() - start;
+  close(fd);
+  report(name, 4096, bytes, cycles, &before);
+}
+
+int main(void) {
+  int fd = open(BENCH_FILE, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    printu("cannot open %s\n", BENCH_FILE);
+    exit(-1);
+  }
+  for (int i = 0; i < sizeof(buf); i++) buf[i] = 'a' + i % 26;
+  for (int done = 0; done < FILE_SIZE; done += sizeof(buf)) write_u(fd, buf, sizeof(buf));
+  close(fd);
+
+  bench_sequential("seq_cold", 4096);
+  bench_sequential("seq_warm", 4096);
+  bench_sequential("seq_warm", 64);
+  bench_sequential("seq_warm", 64 * 1024);
+  bench_random("random_warm");
+
+  exit(0);
+}
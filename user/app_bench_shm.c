@@ -0,0 +1,102 @@
+/*
+ * Benchmark of shared memory segments: the cost of sweeping a segment backed by ordinary
+ * pages and by superpages, and the throughput of a producer/consumer ring in a segment
+ * shared by a parent and its child, synchronised by a mutex and a condition variable.
+ *
+ * Run it by command:
+ * $ make obj/app_bench_shm
+ * $ spike ./obj/riscv-pke ./obj/app_bench_shm
+ */
+
+#include "user_lib.h"
+#include "usync.h"
+#include "util/types.h"
+#include "util/string.h"
+
+#define SWEEP_SIZE (8 * 1024 * 1024)
+#define NSLOTS 16
+#define SLOT_SIZE (16 * 1024)
+#define TOTAL (16 * 1024 * 1024)
+
+// the ring, at the start of the shared segment
+typedef struct ring_t {
+  umutex lock;
+  ucond changed;
+  int head, tail;  // slots written and read so far
+  char slots[NSLOTS][SLOT_SIZE];
+} ring;
+
+static char msg[SLOT_SIZE];
+
+// sweep the segment name twice, one word per page, returns the cycles per page of the
+// second sweep (i.e., the one that does not take the first touch of the pages).
+static uint64 bench_sweep(const char *name, int flags) {
+  int id = shm_create(name, SWEEP_SIZE, flags);
+  volatile char *p = id < 0 ? MAP_FAILED : shm_attach(id);
+  if (p == MAP_FAILED) return 0;
+
+  uint64 cycles = 0;
+  for (int round = 0; round < 2; round++) {
+    uint64 start = rdcycle();
+    for (uint64 off = 0; off < SWEEP_SIZE; off += 4096) p[off]++;
+    cycles = rdcycle() - start;
+  }
+  shm_detach((void *)p);
+  shm_unlink(name);
+  return cycles / (SWEEP_SIZE / 4096);
+}
+
+static void bench_ring(void) {
+  int id = shm_create("bench_ring", sizeof(ring), SHM_HUGE);
+  ring *r = id < 0 ? MAP_FAILED : shm_attach(id);
+  if (r == MAP_FAILED) return;
+
+  int pid = fork();
+  if (pid == 0) {
+    // the consumer
+    for (int n = 0; n < TOTAL / SLOT_SIZE; n++) {
+      umutex_lock(&r->lock);
+      while (r->head == r->tail) ucond_wait(&r->changed, &r->lock);
+      umutex_unlock(&r->lock);
+
+      memcpy(msg, r->slots[r->tail % NSLOTS], SLOT_SIZE);
+
+      umutex_lock(&r->lock);
+      r->tail++;
+      ucond_signal(&r->changed);
+      umutex_unlock(&r->lock);
+    }
+    exit(0);
+  }
+
+  uint64 start = rdcycle();
+  for (int n = 0; n < TOTAL / SLOT_SIZE; n++) {
+    umutex_lock(&r->lock);
+    while (r->head - r->tail == NSLOTS) ucond_wait(&r->changed, &r->lock);
+    umutex_unlock(&r->lock);
+
+    memcpy(r->slots[r->head % NSLOTS], msg, SLOT_SIZE);
+
+    umutex_lock(&r->lock);
+    r->head++;
+    ucond_signal(&r->changed);
+    umutex_unlock(&r->lock);
+  }
+  wait_u(pid, NULL);
+  uint64 cycles = rdcycle() - start;
+  shm_unlink("bench_ring");
+
+  printu("bench_shm ring: bytes=%d cycles=%ld bytes_per_kcycle=%ld\n", TOTAL, cycles,
+         (uint64)TOTAL * 1000 / cycles);
+  shm_detach(r);
+}
+
+int main(void) {
+  uint64 small = bench_sweep("bench_sweep_4k", 0);
+  uint64 huge = bench_sweep("bench_sweep_2m", SHM_HUGE);
+  printu("bench_shm sweep: bytes=%d cycles_per_page_4k=%ld cycles_per_page_2m=%ld\n",
+         SWEEP_SIZE, small, huge);
+
+  bench_ring();
+  exit(0);
+}
@@ -0,0 +1,61 @@
+/*
+ * Benchmark of sleeping: how late a process wakes up from nanosleep_u(), alone and with
+ * NSLEEPERS processes sleeping different lengths at once. while all of them sleep, the
+ * hart waits in wfi, and the timer interrupts only at their deadlines.
+ *
+ * Run it by command:
+ * $ make obj/app_bench_sleep
+ * $ spike ./obj/riscv-pke ./obj/app_bench_sleep
+ */
+
+#include "user_lib.h"
+#include "util/types.h"
+
+#define NROUNDS 20
+#define NSLEEPERS 8
+// 1ms, in nanoseconds
+#define SLEEP_NS 1000000ULL
+// rdtime() runs at 10MHz on spike, i.e., 100ns a unit
+#define NS_PER_TIME 100
+
+// sleep ns nanoseconds, and return how late (in nanoseconds) the wakeup was.
+static uint64 sleep_late(uint64 ns) {
+  uint64 start = rdtime();
+  nanosleep_u(ns);
+  uint64 slept = (rdtime() - start) * NS_PER_TIME;
+  return slept > ns ? slept - ns : 0;
+}
+
+static void bench_single(void) {
+  uint64 late = 0;
+  for (int i = 0; i < NROUNDS; i++) late += sleep_late(SLEEP_NS);
+  printu("bench_sleep single: rounds=%d sleep_ns=%ld avg_late_ns=%ld\n", NROUNDS, SLEEP_NS,
+         late / NROUNDS);
+}
+
+static void bench_many(void) {
+  int pids[NSLEEPERS];
+  for (int i = 0; i < NSLEEPERS; i++) {
+    pids[i] = fork();
+    if (pids[i] == 0) {
+      uint64 late = 0;
+      for (int r = 0; r < NROUNDS; r++) late += sleep_late(SLEEP_NS * (i + 1));
+      // the average lateness (in microseconds) is the exit code.
+      exit(late / NROUNDS / 1000);
+    }
+  }
+
+  uint64 worst = 0;
+  for (int i = 0; i < NSLEEPERS; i++) {
+    int code = 0;
+    if (pids[i] > 0 && wait_u(pids[i], &code) == pids[i] && code > worst) worst = code;
+  }
+  printu("bench_sleep many: sleepers=%d rounds=%d worst_avg_late_us=%ld\n", NSLEEPERS,
+         NROUNDS, worst);
+}
+
+int main(void) {
+  bench_single();
+  bench_many();
+  exit(0);
+}
@@ -0,0 +1,54 @@
+/*
+ * Benchmark of the trap paths of the kernel: the latency of a null syscall (getpid), and
+ * of page faults on a file mapping (each of which also reads the page from the host file).
+ *
+ * Run it by command:
+ * $ make obj/app_bench_syscall
+ * $ spike ./obj/riscv-pke ./obj/app_bench_syscall
+ */
+
+#include "user_lib.h"
+#include "util/types.h"
+
+#define NCALLS 10000
+#define BENCH_FILE "/tmp/pke_bench_fault.tmp"
+#define NPAGES 64
+
+static char page[4096];
+
+//
+// touch each page of a NPAGES-page file mapping once, returns the cycles per fault.
+//
+static uint64 bench_fault(void) {
+  int fd = open(BENCH_FILE, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) return 0;
+  for (int i = 0; i < NPAGES; i++) write_u(fd, page, sizeof(page));
+
+  volatile char *p = mmap_u(0, NPAGES * 4096, PROT_READ, MAP_PRIVATE, fd, 0);
+  if (p == MAP_FAILED) return 0;
+  uint64 start = rdcycle();
+  for (int i = 0; i < NPAGES; i++) (void)p[i * 4096];
+  uint64 cycles = rdcycle() - start;
+
+  munmap_u((void *)p, NPAGES * 4096);
+  close(fd);
+  return cycles / NPAGES;
+}
+
+int main(void) {
+  // warm up the caches and the TLB on the trap path.
+  for (int i = 0; i < 100; i++) getpid_u();
+
+  uint64 start = rdcycle();
+  for (int i = 0; i < NCALLS; i++) getpid_u();
+  uint64 cycles = rdcycle() - start;
+
+  printu("bench_syscall getpid: calls=%d cycles=%ld cycles_per_call=%ld\n", NCALLS, cycles,
+         cycles / NCALLS);
+
+  uint64 fault_cycles = bench_fault();
+  if (fault_cycles)
+    printu("bench_syscall page_fault: faults=%d cycles_per_fault=%ld\n", NPAGES, fault_cycles);
+
+  exit(0);
+}
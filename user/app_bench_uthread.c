@@ -0,0 +1,55 @@
+/*
+ * Benchmark of the user-level threads (user/uthread.c): the cost of a switch between two
+ * threads that yield to each other, and of a round trip over a pair of channels.
+ *
+ * Run it by command:
+ * $ make obj/app_bench_uthread
+ * $ spike ./obj/riscv-pke ./obj/app_bench_uthread
+ */
+
+#include "user_lib.h"
+#include "uthread.h"
+#include "util/types.h"
+
+#define NROUNDS 10000
+
+static uchan ping, pong;
+static uint64 ping_buf[1], pong_buf[1];
+
+static void yielder(void *arg) {
+  for (int i = 0; i < NROUNDS; i++) uthread_yield();
+}
+
+// echoes what comes in on ping back on pong, until ping is closed.
+static void echo(void *arg) {
+  uint64 v;
+  while (uchan_recv(&ping, &v) == 0) uchan_send(&pong, v);
+}
+
+int main(void) {
+  // two threads yielding to each other: 2 * NROUNDS switches.
+  int a = uthread_create(yielder, 0), b = uthread_create(yielder, 0);
+  uint64 start = rdcycle();
+  uthread_join(a);
+  uthread_join(b);
+  uint64 cycles = rdcycle() - start;
+  printu("bench_uthread yield: switches=%d cycles=%ld cycles_per_switch=%ld\n", 2 * NROUNDS,
+         cycles, cycles / (2 * NROUNDS));
+
+  uchan_init(&ping, ping_buf, 1);
+  uchan_init(&pong, pong_buf, 1);
+  int e = uthread_create(echo, 0);
+  start = rdcycle();
+  for (uint64 i = 0; i < NROUNDS; i++) {
+    uint64 v;
+    uchan_send(&ping, i);
+    uchan_recv(&pong, &v);
+  }
+  cycles = rdcycle() - start;
+  uchan_close(&ping);
+  uthread_join(e);
+  printu("bench_uthread channel: round_trips=%d cycles=%ld cycles_per_round_trip=%ld\n",
+         NROUNDS, cycles, cycles / NROUNDS);
+
+  exit(0);
+}
@@ -0,0 +1,50 @@
+/*
+ * Benchmark of small writes to a host file, with and without the kernel write-back buffer.
+ *
+ * Run it by command:
+ * $ make obj/app_bench_write
+ * $ spike ./obj/riscv-pke ./obj/app_bench_write
+ */
+
+#include "user_lib.h"
+#include "util/types.h"
+
+#define BENCH_FILE "/tmp/pke_bench_write.tmp"
+#define RECORD_SIZE 16
+#define NRECORDS 4096
+
+//
+// write NRECORDS records of RECORD_SIZE bytes to BENCH_FILE, opened with extra flags.
+// returns the number of cycles taken, including the final fsync.
+//
+static uint64 bench(int flags) {
+  static char record[RECORD_SIZE] = "0123456789abcde\n";
+
+  int fd = open(BENCH_FILE, O_WRONLY | O_CREAT | O_TRUNC | flags, 0644);
+  if (fd < 0) {
+    printu("cannot open %s\n", BENCH_FILE);
+    exit(-1);
+  }
+
+  uint64 start = rdcycle();
+  for (int i = 0; i < NRECORDS; i++) write_u(fd, record, RECORD_SIZE);
+  fsync_u(fd);
+  uint64 cycles = rdcycle() - start;
+
+  close(fd);
+  return cycles;
+}
+
+static void report(const char *name, uint64 cycles) {
+  // bytes written per 1000 cycles
+  uint64 throughput = (uint64)RECORD_SIZE * NRECORDS * 1000 / cycles;
+  printu("bench_write %s: records=%d size=%d cycles=%ld bytes_per_kcycle=%ld\n", name,
+         NRECORDS, RECORD_SIZE, cycles, throughput);
+}
+
+int main(void) {
+  report("write_through", bench(O_SYNC));
+  report("write_back", bench(0));
+
+  exit(0);
+}
@@ -0,0 +1,160 @@
+/*
+ * memory allocator of the user library, on top of sbrk().
+ *
+ * the heap is cut into spans of SPAN_SIZE bytes (aligned to SPAN_SIZE), each starting with
+ * a span header. a small block (up to MAX_SMALL bytes) is taken from a span dedicated to
+ * its size class: from the free list of the class if it is not empty, or else by bumping
+ * a pointer through the newest span of the class. free() finds the span (and so the class)
+ * of a block by rounding its address down, so blocks carry no header of their own. a large
+ * block takes a run of whole spans, which is kept for reuse when freed.
+ *
+ * the allocator is not shared by anything: each process has its own (a forked child gets a
+ * copy), and uthreads are switched only when they call into uthread.c, never in here. the
+ * free lists thus need no lock, and malloc() and free() only trap into the kernel when a
+ * new span is needed.
+ */
+
+#include "user_lib.h"
+#include "util/types.h"
+#include "util/string.h"
+
+#define SPAN_SIZE (64 * 1024)
+#define MAX_SMALL 2048
+#define ALIGN 16
+
+// block sizes of the classes
+static const uint32 class_size[] = {16,  32,  48,  64,  96,   128,  192,
+                                    256, 384, 512, 768, 1024, 1536, 2048};
+#define NCLASSES (sizeof(class_size) / sizeof(class_size[0]))
+#define LARGE NCLASSES
+
+typedef struct span_t {
+  uint32 cls;     // size class of the blocks, or LARGE
+  uint32 nspans;  // length of the run of spans, for LARGE
+  struct span_t *next;  // next free run, for LARGE
+} span;
+
+// blocks start after the span header, aligned to ALIGN
+#define SPAN_HDR ((sizeof(span) + ALIGN - 1) & ~(ALIGN - 1))
+
+typedef struct free_block_t {
+  struct free_block_t *next;
+} free_block;
+
+// freed blocks of each class, and the unused part [bump, bump_end) of its newest span
+static free_block *free_lists[NCLASSES];
+static char *bump[NCLASSES], *bump_end[NCLASSES];
+// freed runs of spans
+static span *free_runs;
+static malloc_stats stats;
+
+static int size_class(size_t size) {
+  int c = 0;
+  while (class_size[c] < size) c++;
+  return c;
+}
+
+//
+// take n spans from the kernel. the heap is aligned to SPAN_SIZE at the first call.
+//
+static span *new_spans(uint32 n) {
+  char *end = sbrk(0);
+  uint64 pad = -(uint64)end & (SPAN_SIZE - 1);
+  char *start = sbrk(pad + (uint64)n * SPAN_SIZE);
+  if (start == (void *)-1) return NULL;
+
+  stats.nsbrk++;
+  stats.arena += pad + (uint64)n * SPAN_SIZE;
+  span *s = (span *)(start + pad);
+  s->nspans = n;
+  return s;
+}
+
+static void *malloc_large(size_t size) {
+  // the number of spans must fit in uint32 (and the sum below must not wrap around).
+  if (size > (uint64)(uint32)-1 * SPAN_SIZE - SPAN_HDR) return NULL;
+  uint32 n = (SPAN_HDR + size + SPAN_SIZE - 1) / SPAN_SIZE;
+
+  // first fit among the freed runs.
+  span *s = NULL;
+  for (span **pp = &free_runs; *pp; pp = &(*pp)->next) {
+    if ((*pp)->nspans >= n) {
+      s = *pp;
+      *pp = s->next;
+      break;
+    }
+  }
+  if (!s && !(s = new_spans(n))) return NULL;
+
+  s->cls = LARGE;
+  stats.in_use += (uint64)s->nspans * SPAN_SIZE - SPAN_HDR;
+  return (char *)s + SPAN_HDR;
+}
+
+void *malloc(size_t size) {
+  stats.nmalloc++;
+  if (size > MAX_SMALL) return malloc_large(size);
+
+  int c = size_class(size);
+  void *p = free_lists[c];
+  if (p) {
+    free_lists[c] = free_lists[c]->next;
+  } else {
+    if (bump[c] + class_size[c] > bump_end[c]) {
+      span *s = new_spans(1);
+      if (!s) return NULL;
+      s->cls = c;
+      bump[c] = (char *)s + SPAN_HDR;
+      bump_end[c] = (char *)s + SPAN_SIZE;
+    }
+    p = bump[c];
+    bump[c] += class_size[c];
+  }
+
+  stats.in_use += class_size[c];
+  return p;
+}
+
+void free(void *ptr) {
+  if (!ptr) return;
+  stats.nfree++;
+
+  span *s = (span *)((uint64)ptr & ~(uint64)(SPAN_SIZE - 1));
+  if (s->cls == LARGE) {
+    stats.in_use -= (uint64)s->nspans * SPAN_SIZE - SPAN_HDR;
+    s->next = free_runs;
+    free_runs = s;
+    return;
+  }
+
+  free_block *b = (free_block *)ptr;
+  b->next = free_lists[s->cls];
+  free_lists[s->cls] = b;
+  stats.in_use -= class_size[s->cls];
+}
+
+void *calloc(size_t n, size_t size) {
+  if (size && n > (uint64)-1 / size) return NULL;
+  void *p = malloc(n * size);
+  if (p) memset(p, 0, n * size);
+  return p;
+}
+
+void *realloc(void *ptr, size_t size) {
+  if (!ptr) return malloc(size);
+
+  // the block may be large enough already.
+  span *s = (span *)((uint64)ptr & ~(uint64)(SPAN_SIZE - 1));
+  size_t cap = s->cls == LARGE ? (uint64)s->nspans * SPAN_SIZE - SPAN_HDR : class_size[s->cls];
+  if (size <= cap) return ptr;
+
+  void *p = malloc(size);
+  if (!p) return NULL;
+  memcpy(p, ptr, cap);
+  free(ptr);
+  return p;
+}
+
+void malloc_get_stats(malloc_stats *st) {
+  *st = stats;
+}
@@ -8,17 +8,24 @@
 #include "user_lib.h"
 #include "util/types.h"
 #include "util/snprintf.h"
+#include "util/string.h"
+#include "util/functions.h"
+#include "util/print_ring.h"
+#include "util/perf_events.h"
 #include "kernel/syscall.h"
 
-int do_user_call(uint64 sysnum, uint64 a1, uint64 a2, uint64 a3, uint64 a4, uint64 a5, uint64 a6,
+// the console output ring shared with the kernel, NULL unless print_ring_u() enabled it
+static print_ring* pring;
+
+long do_user_call(uint64 sysnum, uint64 a1, uint64 a2, uint64 a3, uint64 a4, uint64 a5, uint64 a6,
                  uint64 a7) {
-  int ret;
+  long ret;
 
   // before invoking the syscall, arguments of do_user_call are already loaded into the argument
   // registers (a0-a7) of our (emulated) risc-v machine.
   asm volatile(
       "ecall\n"
-      "sw a0, %0"  // returns a 32-bit value
+      "sd a0, %0"  // returns a 64-bit value (e.g., an address returned by mmap)
       : "=m"(ret)
       :
       : "memory");
@@ -26,6 +33,32 @@ int do_user_call(uint64 sysnum, uint64 a1, uint64 a2, uint64 a3, uint64 a4, uint
   return ret;
 }
 
+//
+// append n bytes to the console output ring. the kernel drains the ring whenever the app
+// traps, so a syscall is made only when the ring is full, or filled beyond the high-water
+// mark.
+//
+static int ring_print(const char* buf, size_t n) {
+  for (size_t done = 0; done < n;) {
+    uint32 tail = pring->tail;
+    uint32 space = PRINT_RING_SIZE - (tail - pring->head);
+    if (space == 0) {
+      do_user_call(SYS_user_print_flush, 0, 0, 0, 0, 0, 0, 0);
+      continue;
+    }
+
+    uint32 pos = tail % PRINT_RING_SIZE;
+    uint32 cnt = MIN(n - done, MIN(space, PRINT_RING_SIZE - pos));
+    memcpy(pring->data + pos, buf + done, cnt);
+    pring->tail = tail + cnt;
+    done += cnt;
+  }
+
+  if (pring->tail - pring->head >= PRINT_RING_HIGH_WATER)
+    do_user_call(SYS_user_print_flush, 0, 0, 0, 0, 0, 0, 0);
+  return 0;
+}
+
 //
 // printu() supports user/lab1_1_helloworld.c
 //
@@ -39,6 +72,8 @@ int printu(const char* s, ...) {
   const char* buf = out;
   size_t n = res < sizeof(out) ? res : sizeof(out);
 
+  if (pring) return ring_print(buf, n);
+
   // make a syscall to implement the required functionality.
   return do_user_call(SYS_user_print, (uint64)buf, n, 0, 0, 0, 0, 0);
 }
@@ -49,3 +84,265 @@ int printu(const char* s, ...) {
 int exit(int code) {
   return do_user_call(SYS_user_exit, code, 0, 0, 0, 0, 0, 0); 
 }
+
+//
+// open a (host) file, returns a descriptor on success, or a negative value otherwise.
+//
+int open(const char* pathname, int flags, int mode) {
+  return do_user_call(SYS_user_open, (uint64)pathname, flags, mode, 0, 0, 0, 0);
+}
+
+//
+// read at most count bytes from descriptor fd, returns the number of bytes read.
+//
+int read_u(int fd, void* buf, uint64 count) {
+  return do_user_call(SYS_user_read, fd, (uint64)buf, count, 0, 0, 0, 0);
+}
+
+//
+// write count bytes to descriptor fd, returns the number of bytes written.
+//
+int write_u(int fd, const void* buf, uint64 count) {
+  return do_user_call(SYS_user_write, fd, (uint64)buf, count, 0, 0, 0, 0);
+}
+
+//
+// read at most count bytes of fd from offset, without moving the file position.
+//
+int pread_u(int fd, void* buf, uint64 count, uint64 offset) {
+  return do_user_call(SYS_user_pread, fd, (uint64)buf, count, offset, 0, 0, 0);
+}
+
+//
+// reposition the file position of fd, returns the new position.
+//
+int lseek_u(int fd, int64 offset, int whence) {
+  return do_user_call(SYS_user_lseek, fd, offset, whence, 0, 0, 0, 0);
+}
+
+//
+// get the status of the file opened under fd.
+//
+int fstat_u(int fd, struct stat* st) {
+  return do_user_call(SYS_user_fstat, fd, (uint64)st, 0, 0, 0, 0, 0);
+}
+
+//
+// close descriptor fd.
+//
+int close(int fd) {
+  return do_user_call(SYS_user_close, fd, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// write the data buffered by the kernel for fd to the host file.
+//
+int fsync_u(int fd) {
+  return do_user_call(SYS_user_fsync, fd, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// get the hit/miss/eviction counters of the kernel page cache.
+//
+int pcache_stat_u(pcache_stats* st) {
+  return do_user_call(SYS_user_pcache_stat, (uint64)st, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// map length bytes of the file opened under fd (from offset, a multiple of the page size)
+// into memory. pages are read from the file when they are first touched. returns the
+// address of the mapping, or MAP_FAILED.
+//
+void* mmap_u(void* addr, uint64 length, int prot, int flags, int fd, uint64 offset) {
+  return (void*)do_user_call(SYS_user_mmap, (uint64)addr, length, prot, flags, fd, offset, 0);
+}
+
+//
+// remove the mapping made by mmap_u() at addr.
+//
+int munmap_u(void* addr, uint64 length) {
+  return do_user_call(SYS_user_munmap, (uint64)addr, length, 0, 0, 0, 0, 0);
+}
+
+//
+// switch printu() to the console output ring: printing no longer traps into the kernel,
+// which picks up the output on the next trap (e.g., a timer tick) instead.
+//
+int print_ring_u(void) {
+  long va = do_user_call(SYS_user_print_ring, 0, 0, 0, 0, 0, 0, 0);
+  if (va < 0) return -1;
+  pring = (print_ring*)va;
+  return 0;
+}
+
+//
+// get the id of the calling process.
+//
+int getpid_u(void) {
+  return do_user_call(SYS_user_getpid, 0, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// applications need to wait until the word at addr changes from expected, e.g., to build
+// locks (see usync.c). returns at once if it already has.
+//
+int futex_wait(int* addr, int expected) {
+  return do_user_call(SYS_user_futex_wait, (uint64)addr, expected, 0, 0, 0, 0, 0);
+}
+
+//
+// applications need to wake up at most n processes waiting on the word at addr. returns
+// the number of processes woken up.
+//
+int futex_wake(int* addr, int n) {
+  return do_user_call(SYS_user_futex_wake, (uint64)addr, n, 0, 0, 0, 0, 0);
+}
+
+//
+// applications need to create a child process, running a copy of the app. returns the pid
+// of the child in the parent, and 0 in the child.
+//
+int fork(void) {
+  return do_user_call(SYS_user_fork, 0, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// applications need to wait for the child pid (any child if pid is -1) to exit. returns its
+// pid, and stores its exit code at code (unless code is NULL).
+//
+int wait_u(int pid, int* code) {
+  return do_user_call(SYS_user_wait, pid, (uint64)code, 0, 0, 0, 0, 0);
+}
+
+//
+// applications need to create a pipe. fds[0] gets its read end, and fds[1] its write end.
+// a write to a pipe may be short, when the pipe fills up.
+//
+int pipe_u(int fds[2]) {
+  return do_user_call(SYS_user_pipe, (uint64)fds, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// applications need to move the (page-aligned) whole pages of buf into the pipe fd, without
+// copying them. the pages of buf read as zeros afterwards.
+//
+int vmsplice_u(int fd, void* buf, uint64 count) {
+  return do_user_call(SYS_user_vmsplice, fd, (uint64)buf, count, 0, 0, 0, 0);
+}
+
+//
+// applications need to create a shared memory segment of size bytes named name, or to find
+// the existing one of that name. returns the id of the segment, or -1.
+//
+int shm_create(const char* name, uint64 size, int flags) {
+  return do_user_call(SYS_user_shm_create, (uint64)name, size, flags, 0, 0, 0, 0);
+}
+
+//
+// applications need to remove the name of the shared memory segment name. the segment can
+// not be attached anymore, and goes away once no process has it attached. the segments a
+// process created are unlinked when it exits. returns 0, or -1.
+//
+int shm_unlink(const char* name) {
+  return do_user_call(SYS_user_shm_unlink, (uint64)name, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// applications need to map the shared memory segment id. returns its address, or
+// MAP_FAILED. the segment stays attached in the children forked afterwards.
+//
+void* shm_attach(int id) {
+  return (void*)do_user_call(SYS_user_shm_attach, id, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// applications need to unmap the shared memory segment attached at addr.
+//
+int shm_detach(void* addr) {
+  return do_user_call(SYS_user_shm_detach, (uint64)addr, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// applications need to move the end of their heap to addr. returns the new end (the
+// current one if addr is NULL), or (void *)-1.
+//
+void* brk_u(void* addr) {
+  return (void*)do_user_call(SYS_user_brk, (uint64)addr, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// applications need to grow (or shrink) their heap by increment bytes. returns the previous
+// end of the heap, i.e., the start of the new memory, or (void *)-1.
+//
+void* sbrk(int64 increment) {
+  char* old = brk_u(NULL);
+  if (increment == 0) return old;
+  if (brk_u(old + increment) != old + increment) return (void*)-1;
+  return old;
+}
+
+//
+// applications need to sleep for (at least) ns nanoseconds.
+//
+int nanosleep_u(uint64 ns) {
+  return do_user_call(SYS_user_nanosleep, ns, 0, 0, 0, 0, 0, 0);
+}
+
+//
+// applications need to sleep for (at least) the given number of seconds.
+//
+int sleep_u(uint64 seconds) {
+  return nanosleep_u(seconds * 1000000000ULL);
+}
+
+// names of the counters accepted by perf_start() and friends, indexed by enum perf_counter
+static const char* perf_names[NR_PERF_COUNTERS] = {
+  [PERF_CYCLE] = "cycle",
+  [PERF_INSTRET] = "instret",
+  [PERF_HPM3] = "hpm3",
+  [PERF_HPM4] = "hpm4",
+  [PERF_HPM5] = "hpm5",
+  [PERF_HPM6] = "hpm6",
+};
+
+static int perf_counter_of(const char* name) {
+  for (int i = 0; i < NR_PERF_COUNTERS; i++)
+    if (strcmp(perf_names[i], name) == 0) return i;
+  return -1;
+}
+
+static long perf_call(int op, const char* name) {
+  int counter = perf_counter_of(name);
+  if (counter < 0) return -1;
+  return do_user_call(SYS_user_perf, op, counter, 0, 0, 0, 0, 0);
+}
+
+//
+// start counting the named hardware counter ("cycle", "instret", "hpm3" ... "hpm6") for
+// the calling process. only what the process executes in user mode is counted.
+//
+int perf_start(const char* name) {
+  return perf_call(PERF_OP_START, name);
+}
+
+//
+// stop counting the named counter, keeping its count.
+//
+int perf_stop(const char* name) {
+  return perf_call(PERF_OP_STOP, name);
+}
+
+//
+// get the count of the named counter. returns -1 if there is no such counter, or if it is
+// an hpm counter that counts no event on this platform (see HPM_EVENT3 ... in kernel/config.h).
+//
+long perf_read(const char* name) {
+  return perf_call(PERF_OP_READ, name);
+}
+
+//
+// zero the count of the named counter.
+//
+int perf_reset(const char* name) {
+  return perf_call(PERF_OP_RESET, name);
+}
@@ -2,5 +2,105 @@
  * header file to be used by applications.
  */
 
+#include "util/types.h"
+
+// flags of open(), same as those of the host (Linux)
+#define O_RDONLY 00
+#define O_WRONLY 01
+#define O_RDWR 02
+#define O_CREAT 0100
+#define O_TRUNC 01000
+#define O_APPEND 02000
+// writes to the descriptor skip the kernel write-back buffer
+#define O_SYNC 04010000
+
+// whence of lseek_u()
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
+
+// protection and flags of mmap_u(), same as those of the host (Linux)
+#define PROT_READ 1
+#define PROT_WRITE 2
+#define PROT_EXEC 4
+#define MAP_SHARED 0x01
+#define MAP_PRIVATE 0x02
+#define MAP_FAILED ((void *)-1)
+
+// flags of shm_create(): back the segment by 2MB superpages
+#define SHM_HUGE 0x1
+
+struct stat;
+
+// counters of the allocator (user/malloc.c), filled by malloc_get_stats()
+typedef struct malloc_stats_t {
+  uint64 nmalloc;     // calls of malloc() (also through calloc() and realloc())
+  uint64 nfree;       // calls of free() (with a non-NULL pointer)
+  uint64 in_use;      // bytes of the blocks allocated and not freed (block sizes)
+  uint64 arena;       // bytes taken from the kernel by sbrk()
+  uint64 nsbrk;       // calls of sbrk(), i.e., allocations that trapped into the kernel
+} malloc_stats;
+
+// the cycle counter, readable in user mode (e.g., to time a benchmark)
+static inline uint64 rdcycle(void) {
+  uint64 x;
+  asm volatile("rdcycle %0" : "=r"(x));
+  return x;
+}
+
+// the time counter (in units of the timebase, 10MHz on spike), readable in user mode
+static inline uint64 rdtime(void) {
+  uint64 x;
+  asm volatile("rdtime %0" : "=r"(x));
+  return x;
+}
+
+// counters of the kernel page cache (of host files), filled by pcache_stat_u()
+typedef struct pcache_stats_t {
+  uint64 hits;
+  uint64 misses;
+  uint64 evictions;
+  uint64 readahead;
+} pcache_stats;
+
 int printu(const char *s, ...);
 int exit(int code);
+
+int open(const char *pathname, int flags, int mode);
+int read_u(int fd, void *buf, uint64 count);
+int write_u(int fd, const void *buf, uint64 count);
+int pread_u(int fd, void *buf, uint64 count, uint64 offset);
+int lseek_u(int fd, int64 offset, int whence);
+int fstat_u(int fd, struct stat *st);
+int close(int fd);
+int fsync_u(int fd);
+int pcache_stat_u(pcache_stats *st);
+void *mmap_u(void *addr, uint64 length, int prot, int flags, int fd, uint64 offset);
+int munmap_u(void *addr, uint64 length);
+int print_ring_u(void);
+int getpid_u(void);
+int futex_wait(int *addr, int expected);
+int futex_wake(int *addr, int n);
+int fork(void);
+int wait_u(int pid, int *code);
+int pipe_u(int fds[2]);
+int vmsplice_u(int fd, void *buf, uint64 count);
+int shm_create(const char *name, uint64 size, int flags);
+int shm_unlink(const char *name);
+void *shm_attach(int id);
+int shm_detach(void *addr);
+void *brk_u(void *addr);
+void *sbrk(int64 increment);
+int nanosleep_u(uint64 ns);
+int sleep_u(uint64 seconds);
+
+void *malloc(size_t size);
+void *calloc(size_t n, size_t size);
+void *realloc(void *ptr, size_t size);
+void free(void *ptr);
+void malloc_get_stats(malloc_stats *st);
+
+int perf_start(const char *name);
+int perf_stop(const char *name);
+long perf_read(const char *name);
+int perf_reset(const char *name);
@@ -0,0 +1,64 @@
+/*
+ * mutexes and condition variables. both only enter the kernel when they have to: locking
+ * a free mutex, or unlocking one that nobody waits for, is a single atomic instruction.
+ * a process that finds the mutex locked marks it contended (state 2) and sleeps in
+ * futex_wait(), and the owner wakes one sleeper when it unlocks a contended mutex.
+ *
+ * to be shared by processes, the mutex or condition variable has to live in memory they
+ * share. note that a process sleeping in the kernel also stops all of its uthreads.
+ */
+
+#include "usync.h"
+#include "user_lib.h"
+
+static inline int cas(int *p, int old, int new) {
+  __atomic_compare_exchange_n(p, &old, new, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+  return old;
+}
+
+static inline int xchg(int *p, int v) { return __atomic_exchange_n(p, v, __ATOMIC_ACQUIRE); }
+
+void umutex_lock(umutex *m) {
+  int c = cas(&m->state, 0, 1);
+  if (c == 0) return;
+
+  // contended: from now on, the owner has to wake somebody up when unlocking.
+  if (c != 2) c = xchg(&m->state, 2);
+  while (c != 0) {
+    futex_wait(&m->state, 2);
+    c = xchg(&m->state, 2);
+  }
+}
+
+//
+// lock m if it is free. returns 0 if m is locked now, -1 if it is held by somebody else.
+//
+int umutex_trylock(umutex *m) { return cas(&m->state, 0, 1) == 0 ? 0 : -1; }
+
+void umutex_unlock(umutex *m) {
+  if (__atomic_exchange_n(&m->state, 0, __ATOMIC_RELEASE) == 2) futex_wake(&m->state, 1);
+}
+
+//
+// unlock m, wait until c is signalled, and lock m again. as usual, the caller has to
+// re-check its condition, the wait may also end for other reasons.
+//
+void ucond_wait(ucond *c, umutex *m) {
+  int seq = __atomic_load_n(&c->seq, __ATOMIC_RELAXED);
+  umutex_unlock(m);
+  futex_wait(&c->seq, seq);
+
+  // others may have been woken up with us, so lock m as contended: its next unlock then
+  // wakes the next of them.
+  while (xchg(&m->state, 2) != 0) futex_wait(&m->state, 2);
+}
+
+void ucond_signal(ucond *c) {
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  futex_wake(&c->seq, 1);
+}
+
+void ucond_broadcast(ucond *c) {
+  __atomic_fetch_add(&c->seq, 1, __ATOMIC_RELEASE);
+  futex_wake(&c->seq, 0x7fffffff);
+}
@@ -0,0 +1,28 @@
+/*
+ * mutexes and condition variables between processes, built on futex_wait/futex_wake.
+ */
+#ifndef _USYNC_H_
+#define _USYNC_H_
+
+// a mutex: 0 when unlocked, 1 when locked, 2 when locked and (maybe) waited for.
+typedef struct umutex_t {
+  int state;
+} umutex;
+
+// a condition variable: waiters sleep until seq changes.
+typedef struct ucond_t {
+  int seq;
+} ucond;
+
+#define UMUTEX_INIT {0}
+#define UCOND_INIT {0}
+
+void umutex_lock(umutex *m);
+int umutex_trylock(umutex *m);
+void umutex_unlock(umutex *m);
+
+void ucond_wait(ucond *c, umutex *m);
+void ucond_signal(ucond *c);
+void ucond_broadcast(ucond *c);
+
+#endif
@@ -0,0 +1,261 @@
+/*
+ * user-level threads. threads are switched in user mode, by uthread_switch() below, which
+ * saves and restores only the callee-saved registers (and ra, sp): a switch is always a
+ * function call, after which the caller assumes all other registers are clobbered anyway.
+ * so switching costs about a function call, rather than a trap into the kernel.
+ *
+ * scheduling is cooperative: a thread runs until it yields, blocks (on a join or a channel)
+ * or exits, and the next thread is taken from the run queue in FIFO order.
+ */
+
+#include "uthread.h"
+#include "user_lib.h"
+#include "util/string.h"
+
+// the registers saved by uthread_switch()
+typedef struct uthread_context_t {
+  uint64 ra, sp;
+  uint64 s[12];
+} uthread_context;
+
+typedef enum uthread_status_t {
+  UT_FREE,     // slot unused
+  UT_READY,    // in the run queue
+  UT_RUNNING,
+  UT_BLOCKED,  // in a wait queue
+  UT_DONE,     // exited, waiting to be joined
+} uthread_status;
+
+typedef struct uthread_t {
+  uthread_context ctx;
+  uthread_status status;
+  void (*fn)(void *);
+  void *arg;
+  int next;            // next thread in the queue the thread is in, -1 if none
+  uthread_queue joiner;  // the thread waiting in uthread_join() for this one
+  char *stack;         // UTHREAD_STACK_SIZE bytes from the heap, NULL until first needed
+} uthread;
+
+// thread 0 is the main thread of the app, on the stack of the process. its slot in
+// `threads` is taken from the start, and it needs no stack of its own. the stacks of the
+// others come from the heap, so that apps not using threads do not carry them (the user
+// library is linked into every app).
+static uthread threads[UTHREAD_MAX] = {[0] = {.status = UT_RUNNING, .next = -1}};
+static uthread_queue run_queue = UTHREAD_QUEUE_INIT;
+static int current_tid = 0;
+
+//
+// uthread_switch(from, to) saves the context of the caller to from, and continues the
+// context in to. it returns when some thread switches back to from.
+//
+void uthread_switch(uthread_context *from, uthread_context *to);
+asm(".globl uthread_switch\n"
+    "uthread_switch:\n"
+    "  sd ra, 0(a0)\n"
+    "  sd sp, 8(a0)\n"
+    "  sd s0, 16(a0)\n"
+    "  sd s1, 24(a0)\n"
+    "  sd s2, 32(a0)\n"
+    "  sd s3, 40(a0)\n"
+    "  sd s4, 48(a0)\n"
+    "  sd s5, 56(a0)\n"
+    "  sd s6, 64(a0)\n"
+    "  sd s7, 72(a0)\n"
+    "  sd s8, 80(a0)\n"
+    "  sd s9, 88(a0)\n"
+    "  sd s10, 96(a0)\n"
+    "  sd s11, 104(a0)\n"
+    "  ld ra, 0(a1)\n"
+    "  ld sp, 8(a1)\n"
+    "  ld s0, 16(a1)\n"
+    "  ld s1, 24(a1)\n"
+    "  ld s2, 32(a1)\n"
+    "  ld s3, 40(a1)\n"
+    "  ld s4, 48(a1)\n"
+    "  ld s5, 56(a1)\n"
+    "  ld s6, 64(a1)\n"
+    "  ld s7, 72(a1)\n"
+    "  ld s8, 80(a1)\n"
+    "  ld s9, 88(a1)\n"
+    "  ld s10, 96(a1)\n"
+    "  ld s11, 104(a1)\n"
+    "  ret\n");
+
+static void enqueue(uthread_queue *q, int tid) {
+  threads[tid].next = -1;
+  if (q->tail < 0) q->head = tid;
+  else threads[q->tail].next = tid;
+  q->tail = tid;
+}
+
+static int dequeue(uthread_queue *q) {
+  int tid = q->head;
+  if (tid < 0) return -1;
+  q->head = threads[tid].next;
+  if (q->head < 0) q->tail = -1;
+  threads[tid].next = -1;
+  return tid;
+}
+
+//
+// make the threads waiting in q ready to run.
+//
+static void wake_all(uthread_queue *q) {
+  int tid;
+  while ((tid = dequeue(q)) >= 0) {
+    threads[tid].status = UT_READY;
+    enqueue(&run_queue, tid);
+  }
+}
+
+//
+// run the next ready thread. the current thread must have been put somewhere (the run
+// queue, a wait queue) before, or be done. returns when the current thread runs again.
+//
+static void run_next(void) {
+  int next = dequeue(&run_queue);
+  if (next < 0) {
+    // every thread is blocked (or done), nothing can wake any of them up.
+    printu("uthread: deadlock, all threads are blocked\n");
+    exit(-1);
+  }
+
+  int prev = current_tid;
+  current_tid = next;
+  threads[next].status = UT_RUNNING;
+  if (next != prev) uthread_switch(&threads[prev].ctx, &threads[next].ctx);
+}
+
+//
+// block the current thread in q, until wake_all(q).
+//
+static void block_on(uthread_queue *q) {
+  threads[current_tid].status = UT_BLOCKED;
+  enqueue(q, current_tid);
+  run_next();
+}
+
+//
+// the first function of a new thread, which uthread_switch() "returns" to.
+//
+static void uthread_start(void) {
+  uthread *t = &threads[current_tid];
+  t->fn(t->arg);
+  uthread_exit();
+}
+
+//
+// create a thread that runs fn(arg), and put it to the run queue. returns its id, or -1
+// if there are UTHREAD_MAX threads already (or no memory for the stack).
+//
+int uthread_create(void (*fn)(void *), void *arg) {
+  int tid;
+  for (tid = 1; tid < UTHREAD_MAX; tid++)
+    if (threads[tid].status == UT_FREE) break;
+  if (tid == UTHREAD_MAX) return -1;
+
+  uthread *t = &threads[tid];
+  // malloc() aligns blocks to 16 bytes, as the stack pointer must be.
+  char *stack = t->stack ? t->stack : malloc(UTHREAD_STACK_SIZE);
+  if (!stack) return -1;
+
+  memset(t, 0, sizeof(*t));
+  t->stack = stack;
+  t->fn = fn;
+  t->arg = arg;
+  t->joiner.head = t->joiner.tail = -1;
+  t->ctx.ra = (uint64)uthread_start;
+  t->ctx.sp = (uint64)stack + UTHREAD_STACK_SIZE;
+  t->status = UT_READY;
+  enqueue(&run_queue, tid);
+  return tid;
+}
+
+//
+// let the other ready threads run, before the current one goes on.
+//
+void uthread_yield(void) {
+  if (run_queue.head < 0) return;
+  threads[current_tid].status = UT_READY;
+  enqueue(&run_queue, current_tid);
+  run_next();
+}
+
+//
+// wait for thread tid to exit, and free its slot. returns -1 if there is no such thread,
+// or it is the current one.
+//
+int uthread_join(int tid) {
+  if (tid <= 0 || tid >= UTHREAD_MAX || tid == current_tid) return -1;
+  uthread *t = &threads[tid];
+  if (t->status == UT_FREE) return -1;
+
+  while (t->status != UT_DONE) block_on(&t->joiner);
+  t->status = UT_FREE;
+  return 0;
+}
+
+//
+// end the current thread. the main thread (0) ends the app instead.
+//
+void uthread_exit(void) {
+  if (current_tid == 0) exit(0);
+
+  uthread *t = &threads[current_tid];
+  t->status = UT_DONE;
+  wake_all(&t->joiner);
+  run_next();
+}
+
+int uthread_self(void) {
+  return current_tid;
+}
+
+//
+// make c a channel of cap values, kept in buf.
+//
+void uchan_init(uchan *c, uint64 *buf, int cap) {
+  c->buf = buf;
+  c->cap = cap;
+  c->head = c->count = 0;
+  c->closed = 0;
+  c->senders.head = c->senders.tail = -1;
+  c->receivers.head = c->receivers.tail = -1;
+}
+
+//
+// send v to channel c, waiting while it is full. returns 0, or -1 if c is closed.
+//
+int uchan_send(uchan *c, uint64 v) {
+  while (c->count == c->cap && !c->closed) block_on(&c->senders);
+  if (c->closed) return -1;
+
+  c->buf[(c->head + c->count) % c->cap] = v;
+  c->count++;
+  wake_all(&c->receivers);
+  return 0;
+}
+
+//
+// receive a value from channel c to *v, waiting while it is empty. returns 0, or -1 if c
+// is closed and drained.
+//
+int uchan_recv(uchan *c, uint64 *v) {
+  while (c->count == 0 && !c->closed) block_on(&c->receivers);
+  if (c->count == 0) return -1;
+
+  *v = c->buf[c->head];
+  c->head = (c->head + 1) % c->cap;
+  c->count--;
+  wake_all(&c->senders);
+  return 0;
+}
+
+//
+// close channel c: no more sends, and receivers get what is left, then -1.
+//
+void uchan_close(uchan *c) {
+  c->closed = 1;
+  wake_all(&c->senders);
+  wake_all(&c->receivers);
+}
@@ -0,0 +1,44 @@
+/*
+ * user-level (green) threads, switched cooperatively in user mode, and channels between
+ * them.
+ */
+#ifndef _UTHREAD_H_
+#define _UTHREAD_H_
+
+#include "util/types.h"
+
+// at most UTHREAD_MAX threads, including the main thread (thread 0) of the app. the other
+// threads run on stacks of UTHREAD_STACK_SIZE bytes, taken from the heap (by malloc) when
+// a thread slot is first used, and kept for the later threads of the slot.
+#define UTHREAD_MAX 16
+#define UTHREAD_STACK_SIZE (8 * 1024)
+
+// threads waiting for something, in FIFO order
+typedef struct uthread_queue_t {
+  int head, tail;  // thread ids, -1 if the queue is empty
+} uthread_queue;
+
+#define UTHREAD_QUEUE_INIT {-1, -1}
+
+// a channel: a bounded FIFO of 64-bit values. senders block while it is full, and receivers
+// while it is empty.
+typedef struct uchan_t {
+  uint64 *buf;  // cap slots, provided by the creator
+  int cap;
+  int head, count;
+  int closed;
+  uthread_queue senders, receivers;
+} uchan;
+
+int uthread_create(void (*fn)(void *), void *arg);
+void uthread_yield(void);
+int uthread_join(int tid);
+void uthread_exit(void);
+int uthread_self(void);
+
+void uchan_init(uchan *c, uint64 *buf, int cap);
+int uchan_send(uchan *c, uint64 v);
+int uchan_recv(uchan *c, uint64 *v);
+void uchan_close(uchan *c);
+
+#endif
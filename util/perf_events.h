@@ -0,0 +1,26 @@
+#ifndef _PERF_EVENTS_H_
+#define _PERF_EVENTS_H_
+
+// the counters that the kernel virtualizes per process: cycle, instret, and the
+// configurable hpm counters 3..6 (whose events are programmed at boot, see HPM_EVENT3 ...
+// in kernel/config.h, and which are unavailable without one). each process only sees what
+// the counters advanced while it ran in user mode, with the counter started.
+enum perf_counter {
+  PERF_CYCLE,
+  PERF_INSTRET,
+  PERF_HPM3,
+  PERF_HPM4,
+  PERF_HPM5,
+  PERF_HPM6,
+  NR_PERF_COUNTERS
+};
+
+// operations of SYS_user_perf
+enum perf_op {
+  PERF_OP_START,  // start counting
+  PERF_OP_STOP,   // stop counting, the count is kept
+  PERF_OP_READ,   // returns the count
+  PERF_OP_RESET,  // zero the count
+};
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef _PRINT_RING_H_
+#define _PRINT_RING_H_
+
+#include "util/types.h"
+
+// the console output ring is one page, shared by a process and the kernel. the app appends
+// to it without trapping, and the kernel drains it to the console: on every trap of the app
+// (including the timer interrupt, which comes at least every TIMER_INTERVAL while the app
+// may run, see timer_reprogram()), and when the app asks for it (when the ring is full, or
+// filled beyond PRINT_RING_HIGH_WATER).
+// the size of the data area must be a power of two (and so divide 2^32), so that the
+// positions stay in order when the free-running counters wrap around.
+#define PRINT_RING_PAGE 4096
+#define PRINT_RING_SIZE 2048
+#define PRINT_RING_HIGH_WATER (PRINT_RING_SIZE * 3 / 4)
+
+typedef struct print_ring_t {
+  // both counters are free-running. data[head % PRINT_RING_SIZE] is the first byte not
+  // drained yet, and data[tail % PRINT_RING_SIZE] is where the next byte goes.
+  volatile uint32 head;  // advanced by the kernel only
+  volatile uint32 tail;  // advanced by the app only
+  char pad[56];
+  char data[PRINT_RING_SIZE];
+} print_ring;
+
+#endif